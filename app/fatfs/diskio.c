@@ -9,9 +9,108 @@
 
 #include "diskio.h"		/* FatFs lower layer API */
 #include "sdcard.h"
+#include "user_config.h"
+#include "c_stdlib.h"
+#include "c_string.h"
 
 static DSTATUS m_status = STA_NOINIT;
 
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+/* FatFs keeps FAT and directory sectors in a single window, so a file   */
+/* that grows while it is synced makes it swap between the two on every */
+/* cluster. The cache keeps such sectors in RAM. A sector is only taken  */
+/* in when it is read a second time while it is still in the history of */
+/* recent misses, which keeps file data that is read once from flushing  */
+/* the FAT out. Writes go through to the card.                           */
+
+#if FATFS_CACHE_SECTORS > 0
+
+#define HISTORY_LEN  (2 * FATFS_CACHE_SECTORS)
+
+typedef struct {
+  DWORD sector;
+  uint32_t used;	/* LRU stamp, 0 if the entry is empty */
+  BYTE pdrv;
+} cache_entry;
+
+static cache_entry m_cache[FATFS_CACHE_SECTORS];
+static BYTE *m_cache_data;
+static uint32_t m_cache_clock;
+static DWORD m_history[HISTORY_LEN];
+static BYTE m_history_pdrv[HISTORY_LEN];
+static uint8_t m_history_pos;
+
+static BYTE *cache_lookup( BYTE pdrv, DWORD sector )
+{
+  for (int i = 0; i < FATFS_CACHE_SECTORS; i++) {
+    if (m_cache[i].used && m_cache[i].sector == sector && m_cache[i].pdrv == pdrv) {
+      m_cache[i].used = ++m_cache_clock;
+      return m_cache_data + i * 512;
+    }
+  }
+  return NULL;
+}
+
+/* Called on a miss: remember it, or take the sector in if it missed before */
+static void cache_admit( BYTE pdrv, DWORD sector, const BYTE *buff )
+{
+  int i, victim = 0;
+
+  for (i = 0; i < HISTORY_LEN; i++) {
+    if (m_history[i] == sector && m_history_pdrv[i] == pdrv) {
+      break;
+    }
+  }
+  if (i == HISTORY_LEN) {
+    m_history[m_history_pos] = sector;
+    m_history_pdrv[m_history_pos] = pdrv;
+    m_history_pos = (m_history_pos + 1) % HISTORY_LEN;
+    return;
+  }
+  if (!m_cache_data && !(m_cache_data = (BYTE *)c_malloc( FATFS_CACHE_SECTORS * 512 ))) {
+    return;
+  }
+  for (i = 1; i < FATFS_CACHE_SECTORS; i++) {
+    if (m_cache[i].used < m_cache[victim].used) {
+      victim = i;
+    }
+  }
+  m_cache[victim].pdrv = pdrv;
+  m_cache[victim].sector = sector;
+  m_cache[victim].used = ++m_cache_clock;
+  c_memcpy( m_cache_data + victim * 512, buff, 512 );
+}
+
+/* Keep cached copies in step with what is written to the card */
+static void cache_update( BYTE pdrv, DWORD sector, UINT count, const BYTE *buff )
+{
+  for (int i = 0; i < FATFS_CACHE_SECTORS; i++) {
+    if (m_cache[i].used && m_cache[i].pdrv == pdrv &&
+        m_cache[i].sector - sector < count) {
+      c_memcpy( m_cache_data + i * 512, buff + (m_cache[i].sector - sector) * 512, 512 );
+    }
+  }
+}
+
+static void cache_drop( BYTE pdrv )
+{
+  for (int i = 0; i < FATFS_CACHE_SECTORS; i++) {
+    if (m_cache[i].pdrv == pdrv) {
+      m_cache[i].used = 0;
+    }
+  }
+  for (int i = 0; i < HISTORY_LEN; i++) {
+    if (m_history_pdrv[i] == pdrv) {
+      m_history[i] = 0;
+    }
+  }
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -35,6 +134,10 @@ DSTATUS disk_initialize (
 {
   int result;
 
+#if FATFS_CACHE_SECTORS > 0
+  /* the card might have been changed */
+  cache_drop( pdrv );
+#endif
   if (platform_sdcard_init( 1, pdrv )) {
     m_status &= ~STA_NOINIT;
   }
@@ -56,9 +159,19 @@ DRESULT disk_read (
 )
 {
   if (count == 1) {
+#if FATFS_CACHE_SECTORS > 0
+    const BYTE *cached = cache_lookup( pdrv, sector );
+    if (cached) {
+      c_memcpy( buff, cached, 512 );
+      return RES_OK;
+    }
+#endif
     if (! platform_sdcard_read_block( pdrv, sector, buff )) {
       return RES_ERROR;
     }
+#if FATFS_CACHE_SECTORS > 0
+    cache_admit( pdrv, sector, buff );
+#endif
   } else {
     if (! platform_sdcard_read_blocks( pdrv, sector, count, buff )) {
       return RES_ERROR;
@@ -80,14 +193,23 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
+  int ok;
+
   if (count == 1) {
-    if (! platform_sdcard_write_block( pdrv, sector, buff )) {
-      return RES_ERROR;
-    }
+    ok = platform_sdcard_write_block( pdrv, sector, buff );
   } else {
-    if (! platform_sdcard_write_blocks( pdrv, sector, count, buff )) {
-      return RES_ERROR;
-    }
+    ok = platform_sdcard_write_blocks( pdrv, sector, count, buff );
+  }
+#if FATFS_CACHE_SECTORS > 0
+  if (ok) {
+    cache_update( pdrv, sector, count, buff );
+  } else {
+    /* the card's content is unknown now */
+    cache_drop( pdrv );
+  }
+#endif
+  if (! ok) {
+    return RES_ERROR;
   }
 
   return RES_OK;
@@ -4,6 +4,7 @@
 #define f_chmod    fatfslib_f_chmod
 #define f_close    fatfslib_f_close
 #define f_closedir fatfslib_f_closedir
+#define f_expand   fatfslib_f_expand
 #define f_getcwd   fatfslib_f_getcwd
 #define f_getfree  fatfslib_f_getfree
 #define f_getlabel fatfslib_f_getlabel
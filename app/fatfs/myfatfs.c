@@ -26,6 +26,7 @@ static sint32_t myfatfs_eof( const struct vfs_file *fd );
 static sint32_t myfatfs_tell( const struct vfs_file *fd );
 static sint32_t myfatfs_flush( const struct vfs_file *fd );
 static uint32_t myfatfs_fsize( const struct vfs_file *fd );
+static sint32_t myfatfs_expand( const struct vfs_file *fd, uint32_t size );
 static sint32_t myfatfs_ferrno( const struct vfs_file *fd );
 
 static sint32_t  myfatfs_closedir( const struct vfs_dir *dd );
@@ -60,6 +61,7 @@ static vfs_fs_fns myfatfs_fs_fns = {
   .mkdir    = myfatfs_mkdir,
   .fsinfo   = myfatfs_fsinfo,
   .fscfg    = NULL,
+  .fsstat   = NULL,
   .format   = NULL,
   .chdrive  = myfatfs_chdrive,
   .chdir    = myfatfs_chdir,
@@ -76,6 +78,7 @@ static vfs_file_fns myfatfs_file_fns = {
   .tell      = myfatfs_tell,
   .flush     = myfatfs_flush,
   .size      = myfatfs_fsize,
+  .expand    = myfatfs_expand,
   .ferrno    = myfatfs_ferrno
 };
 
@@ -101,6 +104,8 @@ struct myvfs_vol {
 struct myvfs_file {
   struct vfs_file vfs_file;
   FIL fp;
+  int expanded;
+  FSIZE_t written;  // end of the data written to an expanded file
 };
 
 struct myvfs_dir {
@@ -179,6 +184,11 @@ static sint32_t myfatfs_close( const struct vfs_file *fd )
 {
   GET_FIL_FP(fd)
 
+  if (myfd->expanded) {
+    // release the clusters beyond the data
+    f_lseek( fp, myfd->written );
+    f_truncate( fp );
+  }
   last_result = f_close( fp );
 
   // free descriptor memory
@@ -203,6 +213,8 @@ static sint32_t myfatfs_write( const struct vfs_file *fd, const void *ptr, size_
   UINT act_written;
 
   last_result = f_write( fp, ptr, len, &act_written );
+  if (myfd->expanded && f_tell( fp ) > myfd->written)
+    ((struct myvfs_file *)myfd)->written = f_tell( fp );
 
   return last_result == FR_OK ? act_written : VFS_RES_ERR;
 }
@@ -269,6 +281,22 @@ static uint32_t myfatfs_fsize( const struct vfs_file *fd )
   return f_size( fp );
 }
 
+// Allocate a contiguous chain of clusters, so that writing the file needs
+// no FAT updates. The file has the full size until it is closed, when it
+// is cut back to the data written.
+static sint32_t myfatfs_expand( const struct vfs_file *fd, uint32_t size )
+{
+  GET_FIL_FP(fd);
+
+  last_result = f_expand( fp, size, 1 );
+  if (last_result != FR_OK)
+    return VFS_RES_ERR;
+
+  ((struct myvfs_file *)myfd)->expanded = TRUE;
+  ((struct myvfs_file *)myfd)->written = 0;
+  return VFS_RES_OK;
+}
+
 static sint32_t myfatfs_ferrno( const struct vfs_file *fd )
 {
   return -last_result;
@@ -408,6 +436,7 @@ static vfs_file *myfatfs_open( const char *name, const char *mode )
 
       fd->vfs_file.fs_type = VFS_FS_FATFS;
       fd->vfs_file.fns     = &myfatfs_file_fns;
+      fd->expanded = FALSE;
       return (vfs_file *)fd;
     } else {
       c_free( fd );
@@ -46,6 +46,22 @@ static const char log_prefix[] = "HTTP client: ";
  */
 #define HTTP_REQUEST_TIMEOUT_MS    (10000)
 
+/*
+ * Connections open at a time, further requests wait in the queue.
+ */
+#define HTTP_MAX_CONNECTIONS       (4)
+
+/*
+ * Requests sent on a connection before their responses arrive.
+ */
+#define HTTP_PIPELINE_MAX          (4)
+
+/*
+ * Looked up hostnames, and how long their addresses are used.
+ */
+#define HTTP_DNS_CACHE_SIZE        (4)
+#define HTTP_DNS_CACHE_MS          (60000)
+
 /*
  * "full_response" is a string containing all response headers and the response body.
  * "response_body and "http_status" are extracted from "full_response" for convenience.
@@ -55,6 +71,18 @@ static const char log_prefix[] = "HTTP client: ";
  */
 typedef void (* http_callback_t)(char * response_body, int http_status, char ** full_response_p);
 
+/*
+ * Same as http_callback_t, for requests made with http_queue_request().
+ */
+typedef void (* http_done_callback_t)(void * arg, char * response_body, int http_status, char ** full_response_p);
+
+/*
+ * Called with each part of the response body as it arrives, if given to
+ * http_queue_request(). The body is then not collected, and the done_handle
+ * gets an empty response_body when the response is complete.
+ */
+typedef void (* http_data_callback_t)(void * arg, int http_status, const char * data, int len);
+
 /*
  * Call this function to skip URL parsing if the arguments are already in separate variables.
  */
@@ -68,6 +96,24 @@ void ICACHE_FLASH_ATTR http_raw_request(const char * hostname, int port, bool se
  */
 void ICACHE_FLASH_ATTR http_request(const char * url, const char * method, const char * headers, const char * post_data, http_callback_t callback_handle, int redirect_follow_count);
 
+/*
+ * Same as http_request(), with arg passed to the callbacks. If data_handle is given,
+ * it gets the response body as it arrives, which allows for responses larger than
+ * BUFFER_SIZE_MAX. Returns false if the URL is invalid.
+ *
+ * All requests go through a queue. At most HTTP_MAX_CONNECTIONS are open at a time,
+ * and requests to the same server share a connection, pipelined once the server
+ * said it keeps the connection open.
+ */
+bool ICACHE_FLASH_ATTR http_queue_request(const char * url, const char * method, const char * headers, const char * post_data, http_done_callback_t done_handle, http_data_callback_t data_handle, void * arg);
+
+/*
+ * Keep idle connections open for timeout_ms, so that a later request to the same
+ * server can skip the DNS lookup and the TCP (and TLS) handshake. With 0, the
+ * default, a connection is closed once no more requests for its server are queued.
+ */
+void ICACHE_FLASH_ATTR http_keepalive(uint32_t timeout_ms);
+
 /*
  * Post data to a web form.
  * The data should be encoded as any format.
@@ -71,6 +71,10 @@ extern void luaL_assertfail(const char *file, int line, const char *message);
 #define SPIFFS_CACHE 1
 
 //#define BUILD_FATFS
+// Number of sectors of the SD card kept in RAM, 512 bytes each and taken
+// from the heap on first use. FatFs holds FAT and directory sectors in a
+// single window, which the cache backs up. Set to 0 to disable it.
+#define FATFS_CACHE_SECTORS 4
 
 // maximum length of a filename
 #define FS_OBJ_NAME_LEN 31
@@ -78,6 +82,18 @@ extern void luaL_assertfail(const char *file, int line, const char *message);
 // maximum number of open files for SPIFFS
 #define SPIFFS_MAX_OPEN_FILES 4
 
+// Number of 256 byte pages in the SPIFFS cache. It holds the pages read
+// last and a write buffer for each open file that is being written to.
+#define SPIFFS_CACHE_PAGES 6
+// Read up to this many pages at once when a file is read sequentially.
+// Set to 0 to read one page at a time.
+#define SPIFFS_CACHE_READ_AHEAD 4
+
+// Keep this many SPIFFS blocks free by collecting garbage in the background,
+// one block per task, instead of only when a write runs out of space.
+// Comment this out to collect only when writing.
+#define SPIFFS_IDLE_GC_BLOCKS 6
+
 // Uncomment this next line for fastest startup 
 // It reduces the format time dramatically
 // #define SPIFFS_MAX_FILESYSTEM_SIZE	32768
@@ -96,6 +112,24 @@ extern void luaL_assertfail(const char *file, int line, const char *message);
 #define LUA_PROCESS_LINE_SIG 2
 #define LUA_OPTIMIZE_DEBUG      2
 
+// Uncomment this to have the Lua VM dispatch opcodes through a jump table
+// of label addresses rather than a switch. It is usually faster for
+// CPU-bound Lua code at the cost of slightly larger code; compare with
+// tools/luabench before enabling it.
+//#define LUA_USE_THREADED_DISPATCH
+
+// Uncomment this to reserve a Lua flash store of the given size (a multiple
+// of 4KB) right after the firmware. Modules in it run straight from flash,
+// see node.flashreload(). Note that this moves SPIFFS, which then needs to
+// be reformatted.
+//#define LUA_FLASH_STORE 0x10000
+
+// Uncomment this to reserve a region of the given size (a multiple of 4KB,
+// at least 8KB) after the Lua flash store for the ringlog module, which
+// appends fixed size records to it without going through SPIFFS. This
+// moves SPIFFS as well.
+//#define RINGLOG_SIZE 0x10000
+
 #define ENDUSER_SETUP_AP_SSID "SetupGadget"
 
 /*
@@ -41,6 +41,7 @@
 //#define LUA_USE_MODULES_HDC1080
 //#define LUA_USE_MODULES_HMC5883L
 //#define LUA_USE_MODULES_HTTP
+//#define LUA_USE_MODULES_HTTPD
 //#define LUA_USE_MODULES_HX711
 #define LUA_USE_MODULES_I2C
 //#define LUA_USE_MODULES_L3G4200D
@@ -55,6 +56,7 @@
 //#define LUA_USE_MODULES_PWM
 //#define LUA_USE_MODULES_RC
 //#define LUA_USE_MODULES_RFSWITCH
+//#define LUA_USE_MODULES_RINGLOG
 //#define LUA_USE_MODULES_ROTARY
 //#define LUA_USE_MODULES_RTCFIFO
 //#define LUA_USE_MODULES_RTCMEM
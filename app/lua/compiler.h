@@ -6,7 +6,16 @@
 #ifndef __COMPILER_H__
 #define __COMPILER_H__
 
-#if defined(__CC_ARM)       // armcc
+#if defined(LUA_CROSS_COMPILER) // host build (e.g. tools/luabench)
+
+/* const rotables live in the executable image; heap objects never do */
+extern char __executable_start;
+extern char _end;
+
+#define RODATA_START_ADDRESS        (&__executable_start)
+#define RODATA_END_ADDRESS          (&_end)
+
+#elif defined(__CC_ARM)       // armcc
 
 //#warning "Please check scatter file to ensure rodata is in ER_IROM1 region."
 
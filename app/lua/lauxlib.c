@@ -770,6 +770,8 @@ static int l_check_memlimit(lua_State *L, size_t needbytes) {
   if (needbytes > g->memlimit) return 1;
   /* make sure the GC is not disabled. */
   if (!is_block_gc(L)) {
+    if (g->totalbytes >= limit)
+      g->egctriggers++;
     while (g->totalbytes >= limit) {
       /* only allow the GC to finished atleast 1 full cycle. */
       if (g->gcstate == GCSpause && ++cycle_count > 1) break;
@@ -789,8 +791,10 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
     c_free(ptr);
     return NULL;
   }
-  if (L != NULL && (mode & EGC_ALWAYS)) /* always collect memory if requested */
+  if (L != NULL && (mode & EGC_ALWAYS)) { /* always collect memory if requested */
+    G(L)->egctriggers++;
     luaC_fullgc(L);
+  }
   if(nsize > osize && L != NULL) {
 #if defined(LUA_STRESS_EMERGENCY_GC)
     luaC_fullgc(L);
@@ -800,6 +804,7 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   }
   nptr = (void *)c_realloc(ptr, nsize);
   if (nptr == NULL && L != NULL && (mode & EGC_ON_ALLOC_FAILURE)) {
+    G(L)->egctriggers++;
     luaC_fullgc(L); /* emergency full collection. */
     nptr = (void *)c_realloc(ptr, nsize); /* try allocation again */
   }
@@ -510,7 +510,7 @@ static int luaB_index(lua_State *L) {
     lua_pushliteral(L, LUA_VERSION);
     return 1;
   }
-  void *res = luaR_findglobal(keyname, c_strlen(keyname));
+  void *res = luaR_findglobalarg(L, 2);
   if (!res)
     return 0;
   else {
@@ -23,6 +23,8 @@ typedef struct {
  int status;
  DumpTargetInfo target;
  size_t wrote;
+ DumpStringRef ref;
+ void* refdata;
 } DumpState;
 
 #define DumpMem(b,n,size,D)	DumpBlock(b,(n)*(size),D)
@@ -187,6 +189,12 @@ static void DumpString(const TString* s, DumpState* D)
  else
  {
   strsize_t size=( strsize_t )s->tsv.len+1;		/* include trailing '\0' */
+  strsize_t ref=(D->ref) ? D->ref(s,D->refdata) : 0;
+  if (ref)				/* string is in the pool */
+  {
+   DumpSize(ref,D);
+   return;
+  }
   DumpSize(size,D);
   DumpBlock(getstr(s),size,D);
  }
@@ -299,6 +307,15 @@ static void DumpHeader(DumpState* D)
 ** dump Lua function as precompiled chunk with specified target
 */
 int luaU_dump_crosscompile (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip, DumpTargetInfo target)
+{
+ return luaU_dump_pooled(L,f,w,data,strip,target,NULL,NULL);
+}
+
+/*
+** dump Lua function as a chunk of a flash image, with strings that are
+** shared between chunks referring to the image's string pool
+*/
+int luaU_dump_pooled (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip, DumpTargetInfo target, DumpStringRef ref, void* refdata)
 {
  DumpState D;
  D.L=L;
@@ -308,6 +325,8 @@ int luaU_dump_crosscompile (lua_State* L, const Proto* f, lua_Writer w, void* da
  D.status=0;
  D.target=target;
  D.wrote=0;
+ D.ref=ref;
+ D.refdata=refdata;
  DumpHeader(&D);
  DumpFunction(f,NULL,&D);
  return D.status;
@@ -2,7 +2,9 @@
 
 #include "legc.h"
 #include "lstate.h"
+#include "lgc.h"
 #include "c_types.h"
+#include "task/task.h"
 
 void legc_set_mode(lua_State *L, int mode, unsigned limit) {
    global_State *g = G(L); 
@@ -11,3 +13,44 @@ void legc_set_mode(lua_State *L, int mode, unsigned limit) {
    g->memlimit = limit;
 }
 
+void legc_set_budget(lua_State *L, unsigned budget) {
+   G(L)->gcbudget = budget;
+}
+
+// When a budgeted step leaves a collection cycle unfinished, the rest of
+// the cycle is run in budget-sized slices from a low priority task, so
+// that it progresses while the application is idle rather than in the
+// next allocation.
+
+static task_handle_t step_task = 0;
+static bool step_posted = false;
+
+static int legc_step(lua_State *L) {
+   luaC_timedstep(L, G(L)->gcbudget);
+   return 0;
+}
+
+static void legc_step_task(task_param_t param, uint8 prio) {
+   lua_State *L = lua_getstate();
+   global_State *g = G(L);
+   (void)param; (void)prio;
+
+   step_posted = false;
+   if (g->gcbudget == 0 || g->gcstate == GCSpause)
+      return;
+   // __gc metamethods may run, so step in protected mode
+   if (lua_cpcall(L, legc_step, NULL) != 0)
+      lua_pop(L, 1);
+   else if (g->gcstate != GCSpause)
+      legc_post_step(L);
+}
+
+void legc_post_step(lua_State *L) {
+   (void)L;
+   if (step_posted)
+      return;
+   if (!step_task)
+      step_task = task_get_id(legc_step_task);
+   step_posted = task_post_low(step_task, 0);
+}
+
@@ -13,5 +13,9 @@
 
 void legc_set_mode(lua_State *L, int mode, unsigned limit);
 
+// Incremental GC step budget in us (0 = unbounded steps)
+void legc_set_budget(lua_State *L, unsigned budget);
+void legc_post_step(lua_State *L);
+
 #endif
 
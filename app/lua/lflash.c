@@ -0,0 +1,335 @@
+/*
+** Flash-resident Lua function store
+** See Copyright Notice in lua.h
+*/
+
+#define lflash_c
+#define LUA_CORE
+
+#include "lua.h"
+
+#if defined(LUA_FLASH_STORE) && !defined(LUA_CROSS_COMPILER)
+
+#include "c_string.h"
+#include "c_stdlib.h"
+
+#include "lauxlib.h"
+#include "lflash.h"
+#include "lstring.h"
+#include "lundump.h"
+
+#include "platform.h"
+#include "vfs.h"
+#include "task/task.h"
+#include "user_interface.h"
+
+#if (LUA_FLASH_STORE % INTERNAL_FLASH_SECTOR_SIZE) != 0
+#error "LUA_FLASH_STORE must be a multiple of the flash sector size"
+#endif
+
+static const FlashHeader *flash_image = NULL;
+static int flash_checked = 0;
+
+/*
+** Return the image in the store, or NULL if the store is empty or not
+** entirely within the memory mapped megabyte of flash.
+*/
+const FlashHeader *luaN_image (void) {
+  if (!flash_checked) {
+    uint32_t base = platform_flash_get_lua_store_address(NULL);
+    uint32_t mapped = platform_flash_phys2mapped(base);
+    flash_checked = 1;
+    if (mapped == (uint32_t)-1 ||
+        platform_flash_phys2mapped(base + LUA_FLASH_STORE - 1) == (uint32_t)-1) {
+      NODE_ERR("Lua flash store at 0x%x is not mapped\n", base);
+      return NULL;
+    }
+    const FlashHeader *h = (const FlashHeader *)mapped;
+    if (h->magic == LFLASH_MAGIC && h->version == LFLASH_VERSION &&
+        h->size <= LUA_FLASH_STORE) {
+      flash_image = h;
+      luaS_setroarea((const char *)h, h->size);
+    }
+  }
+  return flash_image;
+}
+
+
+static const FlashModule *findmodule (const FlashHeader *h, const char *name) {
+  const FlashModule *m = (const FlashModule *)(h + 1);
+  lu_int32 i;
+  for (i = 0; i < h->nmodules; i++, m++)
+    if (c_strcmp((const char *)h + m->name, name) == 0)
+      return m;
+  return NULL;
+}
+
+
+typedef struct LoadFlash {
+  const char *chunk;
+  size_t size;
+} LoadFlash;
+
+static const char *getFlash (lua_State *L, void *ud, size_t *size) {
+  LoadFlash *lf = (LoadFlash *)ud;
+  if (L == NULL && size == NULL) // direct mode check
+    return lf->chunk;
+  if (lf->size == 0) return NULL;
+  *size = lf->size;
+  lf->size = 0;
+  return lf->chunk;
+}
+
+
+/*
+** Load module `name' from the store. Returns -1 if there is no such
+** module, otherwise the lua_load status with the function or the error
+** message pushed.
+*/
+int luaN_loadmodule (lua_State *L, const char *name) {
+  const FlashHeader *h = luaN_image();
+  const FlashModule *m = h ? findmodule(h, name) : NULL;
+  LoadFlash lf;
+  int status;
+  if (m == NULL)
+    return -1;
+  lf.chunk = (const char *)h + m->chunk;
+  lf.size = m->size;
+  lua_pushfstring(L, "=%s", name);
+  status = lua_load(L, getFlash, &lf, lua_tostring(L, -1));
+  lua_remove(L, -2);  /* chunk name */
+  return status;
+}
+
+
+/* Push an array with the names of the modules in the store */
+void luaN_pushindex (lua_State *L) {
+  const FlashHeader *h = luaN_image();
+  lu_int32 i, n = h ? h->nmodules : 0;
+  const FlashModule *m = h ? (const FlashModule *)(h + 1) : NULL;
+  lua_createtable(L, n, 0);
+  for (i = 0; i < n; i++, m++) {
+    lua_pushstring(L, (const char *)h + m->name);
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+
+/*
+** Rewriting the store pulls the code from under any function loaded from
+** it, so the image is written from a task, once no Lua code is running,
+** and the chip restarts as soon as it is done. The job holds the image
+** header, index and names as they will be written, followed by the names
+** of the files to copy the chunks from. A job without files copies an
+** image built by luac.cross -f; it holds just the header of that image.
+*/
+typedef struct ReloadJob {
+  lu_int32 nfiles;
+  lu_int32 indexsize;  /* bytes of header, index and names */
+  /* index, then zero terminated file names */
+} ReloadJob;
+
+#define jobindex(j)  ((char *)((j) + 1))
+
+static task_handle_t reload_handle = 0;
+
+/* Copy len bytes from offset `from' of a file to flash address addr */
+static int copyfile (const char *fname, uint32_t from, uint32_t addr,
+                     uint32_t len) {
+  char buf[256];
+  int fd = vfs_open(fname, "r");
+  if (!fd)
+    return 0;
+  if (vfs_lseek(fd, from, VFS_SEEK_SET) < 0) {
+    vfs_close(fd);
+    return 0;
+  }
+  while (len > 0) {
+    sint32_t n = vfs_read(fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if (n <= 0 || platform_flash_write(buf, addr, n) != n) {
+      vfs_close(fd);
+      return 0;
+    }
+    addr += n;
+    len -= n;
+  }
+  vfs_close(fd);
+  return 1;
+}
+
+static void reload_task (task_param_t param, uint8 prio) {
+  ReloadJob *job = (ReloadJob *)param;
+  const FlashHeader *h = (const FlashHeader *)jobindex(job);
+  const FlashModule *m = (const FlashModule *)(h + 1);
+  const char *fname = jobindex(job) + job->indexsize;
+  uint32_t sect, base = platform_flash_get_lua_store_address(&sect);
+  uint32_t i;
+  (void)prio;
+
+  for (i = 0; i < LUA_FLASH_STORE / INTERNAL_FLASH_SECTOR_SIZE; i++)
+    if (platform_flash_erase_sector(sect + i) != PLATFORM_OK)
+      goto failed;
+  /* the header goes last, so that an interrupted write leaves no image */
+  if (job->nfiles == 0) {
+    if (!copyfile(fname, sizeof(FlashHeader), base + sizeof(FlashHeader),
+                  h->size - sizeof(FlashHeader)))
+      goto failed;
+  } else {
+    if (platform_flash_write(h + 1, base + sizeof(FlashHeader),
+                             job->indexsize - sizeof(FlashHeader)) == 0)
+      goto failed;
+    for (i = 0; i < job->nfiles; i++, m++) {
+      if (!copyfile(fname, 0, base + m->chunk, m->size))
+        goto failed;
+      fname += c_strlen(fname) + 1;
+    }
+  }
+  if (platform_flash_write(h, base, sizeof(FlashHeader)) == 0)
+    goto failed;
+  NODE_DBG("Lua flash store written, restarting\n");
+  c_free(job);
+  system_restart();
+  return;
+
+failed:
+  NODE_ERR("writing the Lua flash store failed\n");
+  c_free(job);
+  system_restart();
+}
+
+
+static int postjob (lua_State *L, ReloadJob *job) {
+  if (!reload_handle)
+    reload_handle = task_get_id(reload_task);
+  if (!task_post_low(reload_handle, (task_param_t)job)) {
+    c_free(job);
+    return luaL_error(L, "cannot post the flash store update");
+  }
+  return 0;
+}
+
+
+/*
+** Check an image built by luac.cross -f and post a job to copy it. The
+** first chunk must have been compiled for this firmware.
+*/
+static int reloadimage (lua_State *L, const char *f, int fd) {
+  FlashHeader h;
+  FlashModule m;
+  ReloadJob *job;
+  char hdr[LUAC_HEADERSIZE], lhdr[LUAC_HEADERSIZE];
+  int ok = vfs_lseek(fd, 0, VFS_SEEK_SET) >= 0 &&
+           vfs_read(fd, &h, sizeof(h)) == sizeof(h) &&
+           h.version == LFLASH_VERSION && h.nmodules > 0 &&
+           h.size == vfs_size(fd) &&
+           vfs_read(fd, &m, sizeof(m)) == sizeof(m) &&
+           vfs_lseek(fd, m.chunk, VFS_SEEK_SET) >= 0 &&
+           vfs_read(fd, lhdr, LUAC_HEADERSIZE) == LUAC_HEADERSIZE;
+  vfs_close(fd);
+  luaU_header(hdr);
+  if (!ok || c_memcmp(hdr, lhdr, LUAC_HEADERSIZE) != 0)
+    return luaL_error(L, "%s is not an image built for this firmware", f);
+  if (h.size > LUA_FLASH_STORE)
+    return luaL_error(L, "image needs %d bytes, the flash store has %d",
+                      (int)h.size, LUA_FLASH_STORE);
+  job = (ReloadJob *)c_malloc(sizeof(ReloadJob) + sizeof(h) + c_strlen(f) + 1);
+  if (job == NULL)
+    return luaL_error(L, "not enough memory");
+  job->nfiles = 0;
+  job->indexsize = sizeof(h);
+  c_memcpy(jobindex(job), &h, sizeof(h));
+  c_strcpy(jobindex(job) + sizeof(h), f);
+  return postjob(L, job);
+}
+
+
+/*
+** Lua: node.flashreload(file, ...)
+** Build an image of the given .lc files, write it to the store and
+** restart. Each file becomes a module named after it without the
+** extension. A single file holding an image built by luac.cross -f is
+** written as it is.
+*/
+int luaN_reload (lua_State *L) {
+  int i, n = lua_gettop(L);
+  size_t indexsize, namesize = 0, filesize = 0, chunk;
+  ReloadJob *job;
+  FlashHeader *h;
+  FlashModule *m;
+  char *name, *fname;
+  char hdr[LUAC_HEADERSIZE], lhdr[LUAC_HEADERSIZE];
+
+  luaL_argcheck(L, n > 0, 1, "file name expected");
+  if (n == 1) {
+    const char *f = luaL_checkstring(L, 1);
+    int fd = vfs_open(f, "r");
+    lu_int32 magic;
+    if (!fd)
+      return luaL_error(L, "cannot open %s", f);
+    if (vfs_read(fd, &magic, sizeof(magic)) == sizeof(magic) &&
+        magic == LFLASH_MAGIC)
+      return reloadimage(L, f, fd);
+    vfs_close(fd);
+  }
+  luaU_header(hdr);
+  for (i = 1; i <= n; i++) {
+    size_t len;
+    const char *f = luaL_checklstring(L, i, &len);
+    const char *base = vfs_basename(f);
+    luaL_argcheck(L, len > 3 && c_strcmp(f + len - 3, ".lc") == 0, i,
+                  "not a .lc file");
+    namesize += c_strlen(base) - 3 + 1;
+    filesize += len + 1;
+  }
+  indexsize = lflash_align4(sizeof(FlashHeader) + n * sizeof(FlashModule) + namesize);
+
+  job = (ReloadJob *)c_malloc(sizeof(ReloadJob) + indexsize + filesize);
+  if (job == NULL)
+    return luaL_error(L, "not enough memory");
+  c_memset(job, 0, sizeof(ReloadJob) + indexsize);
+  job->nfiles = n;
+  job->indexsize = indexsize;
+  h = (FlashHeader *)jobindex(job);
+  m = (FlashModule *)(h + 1);
+  name = (char *)(m + n);
+  fname = jobindex(job) + indexsize;
+  chunk = indexsize;
+
+  for (i = 1; i <= n; i++, m++) {
+    const char *f = lua_tostring(L, i);
+    const char *base = vfs_basename(f);
+    size_t baselen = c_strlen(base) - 3;
+    int fd = vfs_open(f, "r");
+    if (!fd) {
+      c_free(job);
+      return luaL_error(L, "cannot open %s", f);
+    }
+    m->size = vfs_size(fd);
+    if (vfs_read(fd, lhdr, LUAC_HEADERSIZE) != LUAC_HEADERSIZE ||
+        c_memcmp(hdr, lhdr, LUAC_HEADERSIZE) != 0) {
+      vfs_close(fd);
+      c_free(job);
+      return luaL_error(L, "%s is not a chunk compiled for this firmware", f);
+    }
+    vfs_close(fd);
+    m->name = name - (char *)h;
+    c_memcpy(name, base, baselen);
+    name += baselen + 1;
+    m->chunk = chunk;
+    chunk = lflash_align4(chunk + m->size);
+    c_strcpy(fname, f);
+    fname += c_strlen(f) + 1;
+  }
+  if (chunk > LUA_FLASH_STORE) {
+    c_free(job);
+    return luaL_error(L, "image needs %d bytes, the flash store has %d",
+                      (int)chunk, LUA_FLASH_STORE);
+  }
+  h->magic = LFLASH_MAGIC;
+  h->version = LFLASH_VERSION;
+  h->size = chunk;
+  h->nmodules = n;
+  return postjob(L, job);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+** Flash-resident Lua function store
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lflash_h
+#define lflash_h
+
+#include "lua.h"
+#include "llimits.h"
+
+/*
+** The store holds an image of precompiled chunks in memory mapped flash.
+** The chunks are loaded in direct mode (see lundump.c): their code, line
+** info and string constants are used in place, so only the Proto headers
+** and constant tables take RAM.
+**
+** Image layout (all offsets are from the start of the image):
+**   FlashHeader
+**   FlashModule[nmodules]     index, one entry per module
+**   module names              zero terminated, padded to a multiple of 4
+**   string pool               images built by luac.cross -f only
+**   chunks                    each starting at a multiple of 4
+**
+** Pool strings start at a multiple of 4 plus 4, after their length, and
+** the chunks refer to them by offset (see LUAC_POOLREF in lundump.h).
+*/
+
+#define LFLASH_MAGIC    0x4c464c53  /* "SLFL" */
+#define LFLASH_VERSION  1
+
+typedef struct FlashHeader {
+  lu_int32 magic;
+  lu_int32 version;
+  lu_int32 size;      /* bytes used by the image, including this header */
+  lu_int32 nmodules;  /* number of entries in the index */
+} FlashHeader;
+
+typedef struct FlashModule {
+  lu_int32 name;   /* offset of the module name */
+  lu_int32 chunk;  /* offset of the precompiled chunk */
+  lu_int32 size;   /* size of the chunk */
+} FlashModule;
+
+#define lflash_align4(n)  (((n) + 3) & ~3)
+
+#if defined(LUA_FLASH_STORE) && !defined(LUA_CROSS_COMPILER)
+LUAI_FUNC const FlashHeader *luaN_image (void);
+LUAI_FUNC int luaN_loadmodule (lua_State *L, const char *name);
+LUAI_FUNC void luaN_pushindex (lua_State *L);
+LUAI_FUNC int luaN_reload (lua_State *L);
+#endif
+
+#endif
@@ -23,6 +23,15 @@
 #include "ltm.h"
 #include "lrotable.h"
 
+#ifdef LUA_CROSS_COMPILER
+#include C_HEADER_TIME
+#define gctime()	((lu_int32)((double)clock() * 1000000 / CLOCKS_PER_SEC))
+#else
+#include "user_interface.h"
+#include "legc.h"
+#define gctime()	((lu_int32)system_get_time())
+#endif
+
 #define GCSTEPSIZE	1024u
 #define GCSWEEPMAX	40
 #define GCSWEEPCOST	10
@@ -440,7 +449,7 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
 static void checkSizes (lua_State *L) {
   global_State *g = G(L);
   /* check size of string hash */
-  if (g->strt.nuse < cast(lu_int32, g->strt.size/4) &&
+  if (g->strt.nuse < cast(lu_int32, g->strt.size/4*LUA_STRTAB_LOADFACTOR) &&
       g->strt.size > MINSTRTABSIZE*2)
     luaS_resize(L, g->strt.size/2);  /* table is too big */
   /* it is not safe to re-size the buffer if it is in use. */
@@ -555,6 +564,7 @@ static void atomic (lua_State *L) {
   marktmu(g);  /* mark `preserved' userdata */
   udsize += propagateall(g);  /* remark, to propagate `preserveness' */
   cleartable(g->weak);  /* remove collected objects from weak tables */
+  luaR_clearcache();  /* unreferenced key strings are about to be swept */
   /* flip current white */
   g->currentwhite = cast_byte(otherwhite(g));
   g->sweepstrgc = 0;
@@ -570,6 +580,7 @@ static void sweepstrstep (global_State *g, lua_State *L) {
     g->gcstate = GCSsweep;  /* end sweep-string phase */
   lua_assert(old >= g->totalbytes);
   g->estimate -= old - g->totalbytes;
+  g->gcfreed += old - g->totalbytes;
 }
 
 
@@ -602,6 +613,7 @@ static l_mem singlestep (lua_State *L) {
       }
       lua_assert(old >= g->totalbytes);
       g->estimate -= old - g->totalbytes;
+      g->gcfreed += old - g->totalbytes;
       return GCSWEEPMAX*GCSWEEPCOST;
     }
     case GCSfinalize: {
@@ -614,6 +626,7 @@ static l_mem singlestep (lua_State *L) {
       else {
         g->gcstate = GCSpause;  /* end collection */
         g->gcdept = 0;
+        g->gccycles++;
         return 0;
       }
     }
@@ -622,10 +635,30 @@ static l_mem singlestep (lua_State *L) {
 }
 
 
+/* account for a collector pause that began at `start' */
+static void notepause (global_State *g, lu_int32 start) {
+  lu_int32 d = gctime() - start;
+  if (d > g->gcpausemax)
+    g->gcpausemax = d;
+  g->gcpausetotal += d;
+  g->gcpausecount++;
+  g->gccyclepause += d;
+  if (g->gcstate == GCSpause) {  /* cycle completed? */
+    g->gclastcycle = g->gccyclepause;
+    g->gccyclepause = 0;
+  }
+}
+
+#define overbudget(g,start) \
+  ((g)->gcbudget != 0 && gctime() - (start) >= (g)->gcbudget)
+
+
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
+  lu_int32 start;
   if(is_block_gc(L)) return;
   set_block_gc(L);
+  start = gctime();
   l_mem lim = (GCSTEPSIZE/100) * g->gcstepmul;
   if (lim == 0)
     lim = (MAX_LUMEM-1)/2;  /* no limit */
@@ -636,8 +669,13 @@ void luaC_step (lua_State *L) {
     lim -= singlestep(L);
     if (g->gcstate == GCSpause)
       break;
-  } while (lim > 0);
+  } while (lim > 0 && !overbudget(g, start));
+  notepause(g, start);
   if (g->gcstate != GCSpause) {
+    if (lim > 0)  /* cut short by the budget: owe the work not done */
+      g->gcdept += g->gcstepmul ? (lim/g->gcstepmul) * 100 : GCSTEPSIZE;
+    if (g->gcbudget)
+      luai_gcstepspending(L);  /* finish the cycle in idle time */
     if (g->gcdept < GCSTEPSIZE)
       g->GCthreshold = g->totalbytes + GCSTEPSIZE;  /* - lim/g->gcstepmul;*/
     else {
@@ -652,6 +690,34 @@ void luaC_step (lua_State *L) {
   unset_block_gc(L);
 }
 
+/*
+** Run collector steps for at most `budget' us (but at least one step)
+** without starting a new cycle; used to advance a cycle that is already
+** in progress while the application is idle. Returns 1 if the cycle
+** still has work left.
+*/
+int luaC_timedstep (lua_State *L, lu_int32 budget) {
+  global_State *g = G(L);
+  lu_int32 start;
+  if (is_block_gc(L) || g->gcstate == GCSpause)
+    return 0;
+  set_block_gc(L);
+  start = gctime();
+  if (g->estimate > g->totalbytes)
+    g->estimate = g->totalbytes;
+  do {
+    singlestep(L);
+  } while (g->gcstate != GCSpause && gctime() - start < budget);
+  notepause(g, start);
+  if (g->gcstate == GCSpause) {
+    lua_assert(g->totalbytes >= g->estimate);
+    setthreshold(g);
+    g->gcdept = 0;
+  }
+  unset_block_gc(L);
+  return g->gcstate != GCSpause;
+}
+
 int luaC_sweepstrgc (lua_State *L) {
   global_State *g = G(L);
   if (g->gcstate == GCSsweepstring) {
@@ -663,8 +729,10 @@ int luaC_sweepstrgc (lua_State *L) {
 
 void luaC_fullgc (lua_State *L) {
   global_State *g = G(L);
+  lu_int32 start;
   if(is_block_gc(L)) return;
   set_block_gc(L);
+  start = gctime();
   if (g->gcstate <= GCSpropagate) {
     /* reset sweep marks to sweep all elements (returning them to white) */
     g->sweepstrgc = 0;
@@ -686,6 +754,7 @@ void luaC_fullgc (lua_State *L) {
     singlestep(L);
   }
   setthreshold(g);
+  notepause(g, start);
   unset_block_gc(L);
 }
 
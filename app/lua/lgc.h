@@ -124,6 +124,7 @@ LUAI_FUNC size_t luaC_separateudata (lua_State *L, int all);
 LUAI_FUNC void luaC_callGCTM (lua_State *L);
 LUAI_FUNC void luaC_freeall (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
+LUAI_FUNC int luaC_timedstep (lua_State *L, lu_int32 budget);
 LUAI_FUNC void luaC_fullgc (lua_State *L);
 LUAI_FUNC int luaC_sweepstrgc (lua_State *L);
 LUAI_FUNC void luaC_marknew (lua_State *L, GCObject *o);
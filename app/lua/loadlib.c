@@ -25,6 +25,7 @@
 #include "lauxlib.h"
 #include "lualib.h"
 #include "lrotable.h"
+#include "lflash.h"
 
 /* prefix for open functions in C libraries */
 #define LUA_POF		"luaopen_"
@@ -387,6 +388,22 @@ static void loaderror (lua_State *L, const char *filename) {
 }
 
 
+#if defined(LUA_FLASH_STORE) && !defined(LUA_CROSS_COMPILER)
+static int loader_flash (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  int status = luaN_loadmodule(L, name);
+  if (status < 0) {  /* not in the store */
+    lua_pushfstring(L, "\n\tno module " LUA_QS " in the flash store", name);
+    return 1;
+  }
+  if (status != 0)
+    luaL_error(L, "error loading module " LUA_QS " from the flash store:\n\t%s",
+                  name, lua_tostring(L, -1));
+  return 1;  /* library loaded successfully */
+}
+#endif
+
+
 static int loader_Lua (lua_State *L) {
   const char *filename;
   const char *name = luaL_checkstring(L, 1);
@@ -643,7 +660,11 @@ static const luaL_Reg ll_funcs[] = {
 
 
 static const lua_CFunction loaders[] =
+#if defined(LUA_FLASH_STORE) && !defined(LUA_CROSS_COMPILER)
+  {loader_preload, loader_flash, loader_Lua, loader_C, loader_Croot, NULL};
+#else
   {loader_preload, loader_Lua, loader_C, loader_Croot, NULL};
+#endif
 
 #if LUA_OPTIMIZE_MEMORY > 0
 #undef MIN_OPT_LEVEL
@@ -518,6 +518,7 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of `node' array */
+  lu_byte sizeinline;  /* room allocated with the table for small parts */
   struct Table *metatable;
   TValue *array;  /* array part */
   Node *node;
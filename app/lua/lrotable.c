@@ -8,6 +8,7 @@
 #include "lstring.h"
 #include "lobject.h"
 #include "lapi.h"
+#include "lstate.h"
 
 /* Local defines */
 #define LUAR_FINDFUNCTION     0
@@ -16,6 +17,37 @@
 /* Externally defined read-only table array */
 extern const luaR_table lua_rotable[];
 
+/*
+** Lookup cache. Rotables never change, so the result of looking up an
+** interned key in one can be remembered (including "not found") for as
+** long as the key string lives; the cache is flushed by the collector
+** before any string can be freed. Global ROM module lookups are cached
+** under the lua_rotable array itself.
+*/
+#if LUA_ROTABLE_CACHE_SIZE > 0
+#if (LUA_ROTABLE_CACHE_SIZE & (LUA_ROTABLE_CACHE_SIZE - 1)) != 0
+#error "LUA_ROTABLE_CACHE_SIZE must be a power of 2"
+#endif
+
+typedef struct {
+  const void *table;
+  const TString *key;
+  const void *value;
+} luaR_cacheentry;
+
+static luaR_cacheentry luaR_cache[LUA_ROTABLE_CACHE_SIZE];
+
+#define cacheslot(t, k) \
+  (&luaR_cache[(((size_t)(t) >> 2) ^ (k)->tsv.hash) & (LUA_ROTABLE_CACHE_SIZE - 1)])
+
+void luaR_clearcache(void) {
+  c_memset(luaR_cache, 0, sizeof(luaR_cache));
+}
+#else
+void luaR_clearcache(void) {
+}
+#endif
+
 /* Find a global "read only table" in the constant lua_rotable array */
 void* luaR_findglobal(const char *name, unsigned len) {
   unsigned i;
@@ -29,15 +61,39 @@ void* luaR_findglobal(const char *name, unsigned len) {
   return NULL;
 }
 
-/* Find an entry in a rotable and return it */
-static const TValue* luaR_auxfind(const luaR_entry *pentry, const char *strkey, luaR_numkey numkey, unsigned *ppos) {
+/* Find a global "read only table" by its (interned) name, using the cache */
+void* luaR_findglobalstr(TString *name) {
+#if LUA_ROTABLE_CACHE_SIZE > 0
+  luaR_cacheentry *e = cacheslot(lua_rotable, name);
+  if (e->key == name && e->table == lua_rotable)
+    return (void*)e->value;
+  e->value = luaR_findglobal(getstr(name), name->tsv.len);
+  e->table = lua_rotable;
+  e->key = name;
+  return (void*)e->value;
+#else
+  return luaR_findglobal(getstr(name), name->tsv.len);
+#endif
+}
+
+/* Find a global "read only table" named by the string argument narg */
+void* luaR_findglobalarg(lua_State *L, int narg) {
+  luaL_checkstring(L, narg);
+  return luaR_findglobalstr(rawtsvalue(L->base + narg - 1));
+}
+
+/* Find an entry in a rotable and return it. String keys are matched on
+   their type word first, which carries the key length, so only entries
+   of the right length are compared character by character. */
+static const TValue* luaR_auxfind(const luaR_entry *pentry, const char *strkey, size_t len, luaR_numkey numkey, unsigned *ppos) {
   const TValue *res = NULL;
   unsigned i = 0;
+  int strtype = LRO_STRTYPE(len);
   
   if (pentry == NULL)
     return NULL;  
   while(pentry->key.type != LUA_TNIL) {
-    if ((strkey && (pentry->key.type == LUA_TSTRING) && (!c_strcmp(pentry->key.id.strkey, strkey))) || 
+    if ((strkey && (pentry->key.type == strtype) && (!c_memcmp(pentry->key.id.strkey, strkey, len))) || 
         (!strkey && (pentry->key.type == LUA_TNUMBER) && ((luaR_numkey)pentry->key.id.numkey == numkey))) {
       res = &pentry->value;
       break;
@@ -51,9 +107,9 @@ static const TValue* luaR_auxfind(const luaR_entry *pentry, const char *strkey,
 
 int luaR_findfunction(lua_State *L, const luaR_entry *ptable) {
   const TValue *res = NULL;
-  const char *key = luaL_checkstring(L, 2);
+  luaL_checkstring(L, 2);
     
-  res = luaR_auxfind(ptable, key, 0, NULL);  
+  res = luaR_findentrystr((void*)ptable, rawtsvalue(L->base + 1));
   if (res && ttislightfunction(res)) {
     luaA_pushobject(L, res);
     return 1;
@@ -66,13 +122,28 @@ int luaR_findfunction(lua_State *L, const luaR_entry *ptable) {
    If "strkey" is not NULL, the function will look for a string key,
    otherwise it will look for a number key */
 const TValue* luaR_findentry(void *data, const char *strkey, luaR_numkey numkey, unsigned *ppos) {
-  return luaR_auxfind((const luaR_entry*)data, strkey, numkey, ppos);
+  return luaR_auxfind((const luaR_entry*)data, strkey, strkey ? c_strlen(strkey) : 0, numkey, ppos);
+}
+
+/* Find a string key in a rotable, using the cache */
+const TValue* luaR_findentrystr(void *data, TString *key) {
+#if LUA_ROTABLE_CACHE_SIZE > 0
+  luaR_cacheentry *e = cacheslot(data, key);
+  if (e->key == key && e->table == data)
+    return (const TValue*)e->value;
+  e->value = luaR_auxfind((const luaR_entry*)data, getstr(key), key->tsv.len, 0, NULL);
+  e->table = data;
+  e->key = key;
+  return (const TValue*)e->value;
+#else
+  return luaR_auxfind((const luaR_entry*)data, getstr(key), key->tsv.len, 0, NULL);
+#endif
 }
 
 /* Find the metatable of a given table */
 void* luaR_getmeta(void *data) {
 #ifdef LUA_META_ROTABLES
-  const TValue *res = luaR_auxfind((const luaR_entry*)data, "__metatable", 0, NULL);
+  const TValue *res = luaR_findentry(data, "__metatable", 0, NULL);
   return res && ttisrotable(res) ? rvalue(res) : NULL;
 #else
   return NULL;
@@ -84,7 +155,7 @@ static void luaR_next_helper(lua_State *L, const luaR_entry *pentries, int pos,
   setnilvalue(val);
   if (pentries[pos].key.type != LUA_TNIL) {
     /* Found an entry */
-    if (pentries[pos].key.type == LUA_TSTRING)
+    if (luaR_keytype(&pentries[pos].key) == LUA_TSTRING)
       setsvalue(L, key, luaS_newro(L, pentries[pos].key.id.strkey))
     else
       setnvalue(key, (lua_Number)pentries[pos].key.id.numkey)
@@ -30,13 +30,19 @@
 #endif // #ifdef ELUA_ENDIAN_LITTLE
 #endif // #ifndef LUA_PACK_VALUE
 
-#define LRO_STRKEY(k)   {LUA_TSTRING, {.strkey = k}}
+#define LRO_STRKEY(k)   {LRO_STRTYPE(sizeof("" k) - 1), {.strkey = k}}
 #define LRO_NUMKEY(k)   {LUA_TNUMBER, {.numkey = k}}
 #define LRO_NILKEY      {LUA_TNIL, {.strkey=NULL}}
 
 /* Maximum length of a rotable name and of a string key*/
 #define LUA_MAX_ROTABLE_NAME      32
 
+/* The type word of a string key also holds the key length, which the
+   compiler works out from the literal, so lookups can reject entries of
+   the wrong length with a single compare */
+#define LRO_STRTYPE(len)   (LUA_TSTRING | ((int)(len) << 8))
+#define luaR_keytype(k)    ((k)->type & 0xFF)
+
 /* Type of a numeric key in a rotable */
 typedef int luaR_numkey;
 
@@ -66,8 +72,12 @@ typedef struct
 } luaR_table;
 
 void* luaR_findglobal(const char *key, unsigned len);
+void* luaR_findglobalstr(TString *name);
+void* luaR_findglobalarg(lua_State *L, int narg);
 int luaR_findfunction(lua_State *L, const luaR_entry *ptable);
 const TValue* luaR_findentry(void *data, const char *strkey, luaR_numkey numkey, unsigned *ppos);
+const TValue* luaR_findentrystr(void *data, TString *key);
+void luaR_clearcache(void);
 void luaR_getcstr(char *dest, const TString *src, size_t maxsize);
 void luaR_next(lua_State *L, void *data, TValue *key, TValue *val);
 void* luaR_getmeta(void *data);
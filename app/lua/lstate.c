@@ -21,6 +21,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "lrotable.h"
 
 #define state_size(x)	(sizeof(x) + LUAI_EXTRASPACE)
 #define fromstate(l)	(cast(lu_byte *, (l)) - LUAI_EXTRASPACE)
@@ -104,9 +105,10 @@ static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /* close all upvalues for this thread */
   luaC_freeall(L);  /* collect all objects */
+  luaR_clearcache();
   lua_assert(g->rootgc == obj2gco(L));
   lua_assert(g->strt.nuse == 0);
-  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size, TString *);
+  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.capacity, TString *);
   luaZ_freebuffer(L, &g->buff);
   freestack(L, L);
   lua_assert(g->totalbytes == sizeof(LG));
@@ -164,6 +166,8 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->estimate = 0;
   g->strt.size = 0;
   g->strt.nuse = 0;
+  g->strt.mask = 0;
+  g->strt.capacity = 0;
   g->strt.hash = NULL;
   setnilvalue(registry(L));
   luaZ_initbuffer(L, &g->buff);
@@ -182,6 +186,10 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
   g->gcdept = 0;
+  g->gcbudget = 0;
+  g->gcpausemax = g->gcpausetotal = g->gcpausecount = 0;
+  g->gccycles = g->gccyclepause = g->gclastcycle = 0;
+  g->gcfreed = g->gcallocated = g->egctriggers = 0;
 #ifdef EGC_INITIAL_MODE
   g->egcmode = EGC_INITIAL_MODE;
 #else
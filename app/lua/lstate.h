@@ -35,10 +35,16 @@ struct lua_longjmp;  /* defined in ldo.c */
 
 
 
+/*
+** The string table uses linear hashing: it grows and shrinks one bucket
+** at a time, so that it never has to be rehashed as a whole.
+*/
 typedef struct stringtable {
   GCObject **hash;
   lu_int32 nuse;  /* number of elements */
-  int size;
+  int size;  /* number of buckets in use */
+  int mask;  /* 2^k-1, where 2^(k-1) <= size < 2^k */
+  int capacity;  /* allocated size of `hash' */
 } stringtable;
 
 
@@ -88,6 +94,16 @@ typedef struct global_State {
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
   int egcmode;    /* emergency garbage collection operation mode */
+  lu_int32 gcbudget;  /* max. duration of an incremental GC step in us, 0 = no limit */
+  lu_int32 gcpausemax;  /* longest collector pause seen, in us */
+  lu_int32 gcpausetotal;  /* total time spent in collector pauses, in us */
+  lu_int32 gcpausecount;  /* number of collector pauses */
+  lu_int32 gccycles;  /* number of completed collection cycles */
+  lu_int32 gccyclepause;  /* collector time spent in the current cycle, in us */
+  lu_int32 gclastcycle;  /* collector time spent in the last cycle, in us */
+  lu_int32 gcfreed;  /* bytes freed by the collector */
+  lu_int32 gcallocated;  /* bytes allocated */
+  lu_int32 egctriggers;  /* number of collections forced by the EGC */
   lua_CFunction panic;  /* to be called in unprotected errors */
   TValue l_registry;
   struct lua_State *mainthread;
@@ -21,37 +21,100 @@
 #define LUAS_READONLY_STRING      1
 #define LUAS_REGULAR_STRING       0
 
+/* bucket of hash `h' in a linear hash table of `size' buckets */
+#define strbucket(tb,h) \
+  (((h) & (tb)->mask) < cast(unsigned int, (tb)->size) ? \
+   cast_int((h) & (tb)->mask) : cast_int((h) & ((tb)->mask >> 1)))
+
+
+/*
+** Add bucket `size', moving into it the strings of the bucket it splits
+** from. Strings only ever move to a higher bucket, so an incremental
+** sweep of the string table never misses one.
+*/
+static void splitbucket (stringtable *tb) {
+  int n = tb->size;
+  GCObject **p = &tb->hash[n & (tb->mask >> 1)];
+  GCObject **q = &tb->hash[n];
+  lua_assert(n < tb->capacity && n > tb->mask >> 1);
+  *q = NULL;
+  while (*p) {
+    GCObject *o = *p;
+    if (cast_int(gco2ts(o)->hash & tb->mask) == n) {
+      *p = o->gch.next;  /* unlink it */
+      o->gch.next = *q;  /* and chain it in the new bucket */
+      *q = o;
+    }
+    else
+      p = &o->gch.next;
+  }
+  if (++tb->size > tb->mask)
+    tb->mask = (tb->mask << 1) | 1;
+}
+
+
+/* Remove the last bucket, appending its strings to the one it split from */
+static void mergebucket (stringtable *tb) {
+  int n = --tb->size;
+  GCObject **p;
+  lua_assert(n > 0);
+  if (n <= tb->mask >> 1)
+    tb->mask >>= 1;
+  p = &tb->hash[n & (tb->mask >> 1)];
+  while (*p)
+    p = &(*p)->gch.next;
+  *p = tb->hash[n];
+}
+
+
+static void reallochash (lua_State *L, stringtable *tb, int newcapacity) {
+  luaM_reallocvector(L, tb->hash, tb->capacity, newcapacity, GCObject *);
+  tb->capacity = newcapacity;
+}
+
+
 void luaS_resize (lua_State *L, int newsize) {
   stringtable *tb;
-  int i;
   tb = &G(L)->strt;
   if (luaC_sweepstrgc(L) || newsize == tb->size || is_resizing_strings_gc(L))
     return;  /* cannot resize during GC traverse or doesn't need to be resized */
   set_resizing_strings_gc(L);
   if (newsize > tb->size) {
-    luaM_reallocvector(L, tb->hash, tb->size, newsize, GCObject *);
-    for (i=tb->size; i<newsize; i++) tb->hash[i] = NULL;
-  }
-  /* rehash */
-  for (i=0; i<tb->size; i++) {
-    GCObject *p = tb->hash[i];
-    tb->hash[i] = NULL;
-    while (p) {  /* for each node in the list */
-      GCObject *next = p->gch.next;  /* save next */
-      unsigned int h = gco2ts(p)->hash;
-      int h1 = lmod(h, newsize);  /* new position */
-      lua_assert(cast_int(h%newsize) == lmod(h, newsize));
-      p->gch.next = tb->hash[h1];  /* chain it */
-      tb->hash[h1] = p;
-      p = next;
+    if (newsize > tb->capacity)
+      reallochash(L, tb, newsize);
+    if (tb->size == 0) {  /* initial table */
+      tb->hash[0] = NULL;
+      tb->size = tb->mask = 1;
     }
+    while (tb->size < newsize)
+      splitbucket(tb);
+  }
+  else {
+    while (tb->size > newsize)
+      mergebucket(tb);
+    reallochash(L, tb, newsize);
   }
-  if (newsize < tb->size)
-    luaM_reallocvector(L, tb->hash, tb->size, newsize, GCObject *);
-  tb->size = newsize;
   unset_resizing_strings_gc(L);
 }
 
+
+/*
+** Grow the table by a single bucket. Unlike luaS_resize this is allowed
+** during the sweep of the string table, as splitbucket preserves it.
+*/
+static void growstrtab (lua_State *L) {
+  stringtable *tb = &G(L)->strt;
+  if (is_resizing_strings_gc(L) || tb->size >= MAX_INT/2)
+    return;
+  if (tb->size == tb->capacity) {
+    /* grow the array by a quarter; a GC it may run must not resize it */
+    set_resizing_strings_gc(L);
+    reallochash(L, tb, tb->capacity + (tb->capacity >> 2) + 1);
+    unset_resizing_strings_gc(L);
+  }
+  splitbucket(tb);
+}
+
 static TString *newlstr (lua_State *L, const char *str, size_t l,
                                        unsigned int h, int readonly) {
   TString *ts;
@@ -59,8 +122,8 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
   if (l+1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
     luaM_toobig(L);
   tb = &G(L)->strt;
-  if ((tb->nuse + 1) > cast(lu_int32, tb->size) && tb->size <= MAX_INT/2)
-    luaS_resize(L, tb->size*2);  /* too crowded */
+  if ((tb->nuse + 1) > cast(lu_int32, tb->size)*LUA_STRTAB_LOADFACTOR)
+    growstrtab(L);  /* too crowded */
   ts = cast(TString *, luaM_malloc(L, readonly ? sizeof(char**)+sizeof(TString) : (l+1)*sizeof(char)+sizeof(TString)));
   ts->tsv.len = l;
   ts->tsv.hash = h;
@@ -73,7 +136,7 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
     *(char **)(ts+1) = (char *)str;
     luaS_readonly(ts);
   }
-  h = lmod(h, tb->size);
+  h = strbucket(tb, h);
   ts->tsv.next = tb->hash[h];  /* chain new entry */
   tb->hash[h] = obj2gco(ts);
   tb->nuse++;
@@ -88,7 +151,7 @@ static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, in
   size_t l1;
   for (l1=l; l1>=step; l1-=step)  /* compute hash */
     h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
-  for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
+  for (o = G(L)->strt.hash[strbucket(&G(L)->strt, h)];
        o != NULL;
        o = o->gch.next) {
     TString *ts = rawgco2ts(o);
@@ -101,6 +164,14 @@ static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, in
   return newlstr(L, str, l, h, readonly);  /* not found */
 }
 
+/* extra area of mapped flash whose contents stay put, e.g. a Lua image */
+static const char *ro_area_start, *ro_area_end;
+
+void luaS_setroarea (const char *start, size_t size) {
+  ro_area_start = start;
+  ro_area_end = start + size;
+}
+
 static int lua_is_ptr_in_ro_area(const char *p) {
 #ifdef LUA_CROSS_COMPILER
   return 0;
@@ -108,7 +179,8 @@ static int lua_is_ptr_in_ro_area(const char *p) {
 
 #include "compiler.h"
 
-  return p >= RODATA_START_ADDRESS && p <= RODATA_END_ADDRESS;
+  return (p >= RODATA_START_ADDRESS && p <= RODATA_END_ADDRESS) ||
+         (p >= ro_area_start && p < ro_area_end);
 #endif
 }
 
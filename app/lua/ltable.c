@@ -78,6 +78,26 @@ static const Node dummynode_ = {
 };
 
 
+/*
+** Small tables keep their parts in room allocated together with the
+** Table itself (see LUA_TABLE_INLINE): the array part at the start of
+** the room and the hash part at its end, so that each can change size
+** in place as long as both fit. `sizeinline' counts the room in units
+** of L_Umaxalign.
+*/
+#if LUA_TABLE_INLINE > 32
+#error "LUA_TABLE_INLINE must be at most 32"
+#endif
+
+#define tablehead	((sizeof(Table)+sizeof(L_Umaxalign)-1)/sizeof(L_Umaxalign))
+#define inlinestart(t)	(cast(char *, t) + tablehead*sizeof(L_Umaxalign))
+#define inlineend(t)	(inlinestart(t) + (t)->sizeinline*sizeof(L_Umaxalign))
+#define isinline(t,p)	(cast(char *, p) >= inlinestart(t) && \
+                         cast(char *, p) < inlineend(t))
+#define sizetable(t)	((t)->sizeinline ? \
+	(tablehead+(t)->sizeinline)*sizeof(L_Umaxalign) : sizeof(Table))
+
+
 /*
 ** hash for lua_Numbers
 */
@@ -269,9 +289,39 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
 }
 
 
+/*
+** Move the array part to the room inside the table if it fits there,
+** otherwise to (or within) the heap.
+*/
+static void reallocarray (lua_State *L, Table *t, int oldsize, int size) {
+  TValue *old = t->array;
+  size_t room = inlineend(t) - inlinestart(t);
+  size_t keep = sizeof(TValue) * ((oldsize < size) ? oldsize : size);
+  if (isinline(t, t->node))
+    room -= sizeof(Node) * sizenode(t);
+  if (size > 0 && sizeof(TValue) * size <= room) {
+    t->array = cast(TValue *, inlinestart(t));
+    if (old != NULL && !isinline(t, old)) {
+      c_memcpy(t->array, old, keep);
+      luaM_freearray(L, old, oldsize, TValue);
+    }
+  }
+  else if (isinline(t, old)) {
+    TValue *array = NULL;
+    if (size > 0) {
+      array = luaM_newvector(L, size, TValue);
+      c_memcpy(array, old, keep);
+    }
+    t->array = array;
+  }
+  else
+    luaM_reallocvector(L, t->array, oldsize, size, TValue);
+}
+
+
 static void setarrayvector (lua_State *L, Table *t, int size) {
   int i;
-  luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
+  reallocarray(L, t, t->sizearray, size);
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
   t->sizearray = size;
@@ -287,6 +337,38 @@ static Node *getfreepos (Table *t) {
 }
 
 
+/*
+** Move the hash part to the end of the room inside the table if it fits
+** there, otherwise to (or within) the heap.
+*/
+static void reallocnode (lua_State *L, Table *t, int oldsize, int size) {
+  Node *old = (t->node == dummynode) ? NULL : t->node;
+  Node *node;
+  size_t room = inlineend(t) - inlinestart(t);
+  size_t keep = sizeof(Node) * ((oldsize < size) ? oldsize : size);
+  if (isinline(t, t->array))
+    room -= sizeof(TValue) * t->sizearray;
+  if (sizeof(Node) * size <= room) {
+    node = cast(Node *, inlineend(t)) - size;
+    if (isinline(t, old))
+      c_memmove(node, old, keep);
+    else if (old != NULL) {
+      c_memcpy(node, old, keep);
+      luaM_freearray(L, old, oldsize, Node);
+    }
+  }
+  else if (isinline(t, old)) {
+    node = luaM_newvector(L, size, Node);
+    c_memcpy(node, old, keep);
+  }
+  else {
+    node = old;
+    luaM_reallocvector(L, node, oldsize, size, Node);
+  }
+  t->node = node;
+}
+
+
 static void resizenodevector (lua_State *L, Table *t, int oldsize, int newsize) {
   int lsize;
   if (newsize == 0) {  /* no elements to hash part? */
@@ -294,18 +376,14 @@ static void resizenodevector (lua_State *L, Table *t, int oldsize, int newsize)
     lsize = 0;
   }
   else {
-    Node *node = t->node;
     int i;
     lsize = ceillog2(newsize);
     if (lsize > MAXBITS)
       luaG_runerror(L, "table overflow");
     newsize = twoto(lsize);
-    if (node == dummynode) {
+    if (t->node == dummynode)
       oldsize = 0;
-      node = NULL; /* don't try to realloc `dummynode' pointer. */
-    }
-    luaM_reallocvector(L, node, oldsize, newsize, Node);
-    t->node = node;
+    reallocnode(L, t, oldsize, newsize);
     for (i=oldsize; i<newsize; i++) {
       Node *n = gnode(t, i);
       gnext(n) = NULL;
@@ -454,7 +532,7 @@ static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
         setobjt2t(L, luaH_setnum(L, t, i+1), &t->array[i]);
     }
     /* shrink array */
-    luaM_reallocvector(L, t->array, oldasize, nasize, TValue);
+    reallocarray(L, t, oldasize, nasize);
   }
 }
 
@@ -491,7 +569,19 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
 
 
 Table *luaH_new (lua_State *L, int narray, int nhash) {
-  Table *t = luaM_new(L, Table);
+  size_t room = sizeof(TValue) * narray;
+  Table *t;
+  if (nhash > 0 && nhash <= LUA_TABLE_INLINE)
+    room += sizeof(Node) * twoto(ceillog2(nhash));
+  if (room > 0 && room <= sizeof(Node) * LUA_TABLE_INLINE) {
+    room = (room + sizeof(L_Umaxalign) - 1) / sizeof(L_Umaxalign);
+    t = cast(Table *, luaM_malloc(L, (tablehead + room) * sizeof(L_Umaxalign)));
+    t->sizeinline = cast_byte(room);
+  }
+  else {
+    t = luaM_new(L, Table);
+    t->sizeinline = 0;
+  }
   luaC_link(L, obj2gco(t), LUA_TTABLE);
   sethvalue2s(L, L->top, t); /* put table on stack */
   incr_top(L);
@@ -510,10 +600,11 @@ Table *luaH_new (lua_State *L, int narray, int nhash) {
 
 
 void luaH_free (lua_State *L, Table *t) {
-  if (t->node != dummynode)
+  if (t->node != dummynode && !isinline(t, t->node))
     luaM_freearray(L, t->node, sizenode(t), Node);
-  luaM_freearray(L, t->array, t->sizearray, TValue);
-  luaM_free(L, t);
+  if (!isinline(t, t->array))
+    luaM_freearray(L, t->array, t->sizearray, TValue);
+  luaM_freemem(L, t, sizetable(t));
 }
 
 
@@ -599,12 +690,10 @@ const TValue *luaH_getstr (Table *t, TString *key) {
 
 /* same thing for rotables */
 const TValue *luaH_getstr_ro (void *t, TString *key) {
-  char keyname[LUA_MAX_ROTABLE_NAME + 1];
   const TValue *res;  
   if (!t)
     return luaO_nilobject;
-  luaR_getcstr(keyname, key, LUA_MAX_ROTABLE_NAME);   
-  res = luaR_findentry(t, keyname, 0, NULL);
+  res = luaR_findentrystr(t, key);
   return res ? res : luaO_nilobject;
 }
 
@@ -33,6 +33,8 @@
 #define c_getenv getenv
 #define c_memcmp memcmp
 #define c_memcpy memcpy
+#define c_memmove memmove
+#define c_memset memset
 #define c_printf printf
 #define c_puts puts
 #define c_reader reader
@@ -11,6 +11,8 @@
 #include C_HEADER_STDIO
 #include C_HEADER_STDLIB
 #include C_HEADER_STRING
+#include <dirent.h>
+#include <sys/stat.h>
 
 #define luac_c
 #define LUA_CORE
@@ -24,7 +26,9 @@
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstring.h"
+#include "ltable.h"
 #include "lundump.h"
+#include "lflash.h"
 
 #define PROGNAME	"luac"		/* default program name */
 #define	OUTPUT		PROGNAME ".out"	/* default output file */
@@ -32,6 +36,7 @@
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
+static int flashimage=0;		/* build a flash image? */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
@@ -60,6 +65,8 @@ static void usage(const char* message)
  "Available options are:\n"
  "  -        process stdin\n"
  "  -l       list\n"
+ "  -f       build a flash image of the modules in the given files and\n"
+ "           directories\n"
  "  -o name  output to file " LUA_QL("name") " (default is \"%s\")\n"
  "  -p       parse only\n"
  "  -s       strip debug information\n"
@@ -91,6 +98,8 @@ static int doargs(int argc, char* argv[])
   }
   else if (IS("-"))			/* end of options; use stdin */
    break;
+  else if (IS("-f"))			/* build flash image */
+   flashimage=1;
   else if (IS("-l"))			/* list */
    ++listing;
   else if (IS("-o"))			/* output file */
@@ -184,6 +193,232 @@ static int writer(lua_State* L, const void* p, size_t size, void* u)
  return (fwrite(p,size,1,(FILE*)u)!=1) && (size!=0);
 }
 
+/*
+** Flash images (see lflash.h) -- every module is compiled into a chunk of
+** its own, so that require() loads just the modules it needs, and the
+** strings used more than once are stored only once, in a pool that the
+** chunks refer to.
+*/
+
+typedef struct ImgBuf {
+ char* b;
+ size_t n;
+ size_t size;
+} ImgBuf;
+
+static void imgput(ImgBuf* B, const void* p, size_t size)
+{
+ if (B->n+size>B->size)
+ {
+  B->size=(B->n+size)*2;
+  B->b=realloc(B->b,B->size);
+  if (B->b==NULL) fatal("not enough memory for flash image");
+ }
+ if (p) memcpy(B->b+B->n,p,size); else memset(B->b+B->n,0,size);
+ B->n+=size;
+}
+
+static void imgalign(ImgBuf* B)
+{
+ imgput(B,NULL,lflash_align4(B->n)-B->n);
+}
+
+/* store a word of the image in target byte order */
+static void imgset(ImgBuf* B, size_t at, uint32_t x)
+{
+ int i;
+ for (i=0; i<4; i++)
+ {
+  int shift=target.little_endian ? 8*i : 8*(3-i);
+  B->b[at+i]=(char)(x>>shift);
+ }
+}
+
+static void imgput32(ImgBuf* B, uint32_t x)
+{
+ imgput(B,NULL,4);
+ imgset(B,B->n-4,x);
+}
+
+#define protoat(L,i) (clvalue(L->base+(i)-1)->l.p)
+
+static int imgwriter(lua_State* L, const void* p, size_t size, void* u)
+{
+ UNUSED(L);
+ imgput((ImgBuf*)u,p,size);
+ return 0;
+}
+
+static void addmodule(lua_State* L, const char* filename, const char* name)
+{
+ if (!lua_checkstack(L,2)) fatal("too many input files");
+ if (luaL_loadfile(L,filename)!=0) fatal(lua_tostring(L,-1));
+ lua_pushstring(L,name);
+}
+
+static int lua_suffix(const char* name)
+{
+ size_t l=strlen(name);
+ return l>4 && strcmp(name+l-4,".lua")==0;
+}
+
+/* add the .lua files under a directory; subdirectories add a prefix */
+static void adddir(lua_State* L, const char* dir, const char* prefix)
+{
+ struct dirent** list;
+ int i,n=scandir(dir,&list,NULL,alphasort);
+ if (n<0) fatal(lua_pushfstring(L,"cannot read directory %s",dir));
+ for (i=0; i<n; i++)
+ {
+  const char* e=list[i]->d_name;
+  char* path=malloc(strlen(dir)+strlen(e)+2);
+  char* name=malloc(strlen(prefix)+strlen(e)+2);
+  struct stat st;
+  if (path==NULL || name==NULL) fatal("not enough memory");
+  sprintf(path,"%s/%s",dir,e);
+  sprintf(name,"%s%s",prefix,e);
+  if (*e=='.')
+   ;					/* skip hidden files, . and .. */
+  else if (stat(path,&st)==0 && S_ISDIR(st.st_mode))
+  {
+   strcat(name,".");
+   adddir(L,path,name);
+  }
+  else if (lua_suffix(e))
+  {
+   name[strlen(name)-4]='\0';
+   addmodule(L,path,name);
+  }
+  free(path);
+  free(name);
+  free(list[i]);
+ }
+ free(list);
+}
+
+/* count the uses of each string in f and its nested functions */
+static void countstrings(lua_State* L, Table* t, const Proto* f);
+
+static void countstring(lua_State* L, Table* t, TString* s)
+{
+ TValue* v;
+ if (s==NULL) return;
+ v=luaH_setstr(L,t,s);
+ setnvalue(v,ttisnil(v) ? 1 : nvalue(v)+1);
+}
+
+static void countstrings(lua_State* L, Table* t, const Proto* f)
+{
+ int i;
+ for (i=0; i<f->sizek; i++)
+  if (ttisstring(&f->k[i])) countstring(L,t,rawtsvalue(&f->k[i]));
+ if (!stripping)
+ {
+  countstring(L,t,f->source);
+  for (i=0; i<f->sizelocvars; i++) countstring(L,t,f->locvars[i].varname);
+  for (i=0; i<f->sizeupvalues; i++) countstring(L,t,f->upvalues[i]);
+ }
+ for (i=0; i<f->sizep; i++) countstrings(L,t,f->p[i]);
+}
+
+typedef struct PoolRef {
+ Table* pool;				/* string -> offset in image */
+ size_t chunk;				/* offset of the chunk being dumped */
+} PoolRef;
+
+static strsize_t poolref(const TString* s, void* ud)
+{
+ PoolRef* r=(PoolRef*)ud;
+ const TValue* o=luaH_getstr(r->pool,(TString*)s);
+ return ttisnumber(o) ? LUAC_POOLREF|(strsize_t)(r->chunk-(size_t)nvalue(o)) : 0;
+}
+
+static void buildimage(lua_State* L, int argc, char** argv)
+{
+ ImgBuf B={NULL,0,0};
+ PoolRef ref;
+ Table *count,*pool;
+ int i,n,base;
+ size_t index;
+ FILE* D;
+ if (target.sizeof_strsize_t!=4) fatal("flash images need 32-bit string sizes");
+ base=lua_gettop(L);
+ for (i=0; i<argc; i++)
+ {
+  struct stat st;
+  if (stat(argv[i],&st)==0 && S_ISDIR(st.st_mode))
+   adddir(L,argv[i],"");
+  else
+  {
+   const char* b=strrchr(argv[i],'/');
+   char* name=strdup((b==NULL) ? argv[i] : b+1);
+   if (name==NULL) fatal("not enough memory");
+   if (lua_suffix(name)) name[strlen(name)-4]='\0';
+   addmodule(L,argv[i],name);
+   free(name);
+  }
+ }
+ n=(lua_gettop(L)-base)/2;		/* stack holds function, name pairs */
+ if (n==0) fatal("no modules found");
+ /* find the strings used more than once */
+ lua_newtable(L);
+ count=hvalue(L->top-1);
+ lua_newtable(L);
+ pool=hvalue(L->top-1);
+ for (i=0; i<n; i++) countstrings(L,count,protoat(L,base+2*i+1));
+ /* header and index, then names */
+ imgput(&B,NULL,sizeof(FlashHeader)+n*sizeof(FlashModule));
+ index=sizeof(FlashHeader);
+ for (i=0; i<n; i++)
+ {
+  size_t l;
+  const char* name=lua_tolstring(L,base+2*i+2,&l);
+  imgset(&B,index+i*sizeof(FlashModule),B.n);
+  imgput(&B,name,l+1);
+ }
+ /* the string pool */
+ lua_pushnil(L);
+ while (lua_next(L,-3))
+ {
+  if (lua_tonumber(L,-1)>1)
+  {
+   size_t l;
+   const char* s=lua_tolstring(L,-2,&l);
+   imgalign(&B);
+   imgput32(&B,l);
+   setnvalue(luaH_setstr(L,pool,rawtsvalue(L->top-2)),(lua_Number)B.n);
+   imgput(&B,s,l+1);
+  }
+  lua_pop(L,1);
+ }
+ /* the chunks */
+ ref.pool=pool;
+ for (i=0; i<n; i++)
+ {
+  const Proto* f=protoat(L,base+2*i+1);
+  size_t at=index+i*sizeof(FlashModule);
+  int result;
+  imgalign(&B);
+  ref.chunk=B.n;
+  if (listing) luaU_print(f,listing>1);
+  result=luaU_dump_pooled(L,f,imgwriter,&B,stripping,target,poolref,&ref);
+  if (result==LUA_ERR_CC_INTOVERFLOW) fatal("value too big or small for target integer type");
+  if (result==LUA_ERR_CC_NOTINTEGER) fatal("target lua_Number is integral but fractional value found");
+  imgset(&B,at+4,ref.chunk);
+  imgset(&B,at+8,B.n-ref.chunk);
+ }
+ imgalign(&B);
+ imgset(&B,0,LFLASH_MAGIC);
+ imgset(&B,4,LFLASH_VERSION);
+ imgset(&B,8,B.n);
+ imgset(&B,12,n);
+ D=(output==NULL) ? stdout : fopen(output,"wb");
+ if (D==NULL) cannot("open");
+ if (fwrite(B.b,B.n,1,D)!=1) cannot("write");
+ if (fclose(D)) cannot("close");
+ free(B.b);
+}
+
 struct Smain {
  int argc;
  char** argv;
@@ -196,6 +431,11 @@ static int pmain(lua_State* L)
  char** argv=s->argv;
  const Proto* f;
  int i;
+ if (flashimage)
+ {
+  buildimage(L,argc,argv);
+  return 0;
+ }
  if (!lua_checkstack(L,argc)) fatal("too many input files");
  for (i=0; i<argc; i++)
  {
@@ -862,6 +862,17 @@ union luai_Cast { double l_d; long l_l; };
 #define luai_userstateresume(L,n)	((void)L)
 #define luai_userstateyield(L,n)	((void)L)
 
+/*
+@@ luai_gcstepspending is called when a time-bounded GC step stopped with
+@* the collection cycle still in progress, so that the rest of the cycle
+@* can be run in small slices when the application is idle.
+*/
+#ifdef LUA_CROSS_COMPILER
+#define luai_gcstepspending(L)		((void)L)
+#else
+#define luai_gcstepspending(L)		legc_post_step(L)
+#endif
+
 
 /*
 @@ LUA_INTFRMLEN is the length modifier for integer conversions
@@ -898,6 +909,45 @@ union luai_Cast { double l_d; long l_l; };
 #define LUA_META_ROTABLES 
 #endif
 
+/* LUA_ROTABLE_CACHE_SIZE is the number of slots in the cache that remembers
+   the results of rotable and ROM module lookups by (interned) key, so that
+   repeated accesses like gpio.write skip the linear scan of the ROM tables.
+   Each slot costs 12 bytes of RAM; it must be a power of 2, or 0 to disable
+   the cache.
+*/
+#ifndef LUA_ROTABLE_CACHE_SIZE
+#define LUA_ROTABLE_CACHE_SIZE 32
+#endif
+
+/* LUA_STRTAB_LOADFACTOR is the average number of strings per bucket of the
+   string table at which it grows by another bucket. Raising it to 2 or 4
+   halves or quarters the RAM used by the table in string-heavy
+   applications, at the cost of longer chains to search when interning.
+*/
+#ifndef LUA_STRTAB_LOADFACTOR
+#define LUA_STRTAB_LOADFACTOR 1
+#endif
+
+/* LUA_TABLE_INLINE is the number of hash nodes' worth of room that a new
+   table may allocate together with its header for its array and hash
+   parts, so that small tables built by constructors such as {x=1, y=2} or
+   {1, 2, 3} take a single allocation. An array slot takes half a node.
+   The parts move out to blocks of their own if they grow beyond the room.
+   0 allocates every part separately.
+*/
+#ifndef LUA_TABLE_INLINE
+#define LUA_TABLE_INLINE 4
+#endif
+
+/* If you define LUA_USE_THREADED_DISPATCH (see user_config.h), luaV_execute
+   jumps between opcode handlers through a table of label addresses instead
+   of going round a switch. This needs GCC's "labels as values" extension;
+   other compilers fall back to the switch.
+*/
+#if defined(LUA_USE_THREADED_DISPATCH) && !defined(__GNUC__)
+#undef LUA_USE_THREADED_DISPATCH
+#endif
+
 #if LUA_OPTIMIZE_MEMORY == 2 && defined(LUA_USE_POPEN)
 #error "Pipes not supported in aggresive optimization mode (LUA_OPTIMIZE_MEMORY=2)"
 #endif
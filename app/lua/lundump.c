@@ -162,13 +162,30 @@ static TString* LoadString(LoadState* S)
  LoadVar(S,size);
  if (size==0)
   return NULL;
+ else if (size<0)
+ {
+  /* string in the pool of a flash image, preceded by its length */
+  const char* s;
+  IF (!luaZ_direct_mode(S->Z), "bad string");
+  s=luaZ_get_base_address(S->Z)-((uint32_t)size&~LUAC_POOLREF);
+  return luaS_newrolstr(S->L,s,*(const uint32_t*)(s-sizeof(uint32_t)));
+ }
  else
  {
   char* s;
   if (!luaZ_direct_mode(S->Z)) {
-   s = luaZ_openspace(S->L,S->b,size);
-   LoadBlock(S,s,size);
-   return luaS_newlstr(S->L,s,size-1); /* remove trailing zero */
+   TString* ts;
+   const char* p = luaZ_peek(S->Z,(size_t)size);
+   if (p == NULL) {  /* string straddles reader buffers */
+    s = luaZ_openspace(S->L,S->b,size);
+    LoadBlock(S,s,size);
+    return luaS_newlstr(S->L,s,size-1); /* remove trailing zero */
+   }
+   /* intern straight from the reader's buffer; if the chunk is in flash
+      luaS_newlstr references the string in place */
+   ts = luaS_newlstr(S->L,p,size-1);
+   LoadBlock(S,NULL,size);
+   return ts;
   } else {
    s = (char*)luaZ_get_crt_address(S->Z);
    LoadBlock(S,NULL,size);
@@ -37,6 +37,12 @@ LUAI_FUNC void luaU_header (char* h);
 /* dump one chunk to a different target; from ldump.c */
 int luaU_dump_crosscompile (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip, DumpTargetInfo target);
 
+/* maps a string to a string pool reference, or to 0 to dump it inline */
+typedef strsize_t (*DumpStringRef) (const TString* s, void* ud);
+
+/* dump one chunk of a flash image, with strings from its pool; from ldump.c */
+int luaU_dump_pooled (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip, DumpTargetInfo target, DumpStringRef ref, void* refdata);
+
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip);
 
@@ -54,6 +60,11 @@ LUAI_FUNC void luaU_print (const Proto* f, int full);
 /* size of header of binary files */
 #define LUAC_HEADERSIZE		12
 
+/* a string size with this bit set is a reference to a string in the pool
+   of a flash image, this many bytes before the start of the chunk; the
+   string is preceded by its length (see lflash.h) */
+#define LUAC_POOLREF		0x80000000u
+
 /* error codes from cross-compiler */
 /* target integer is too small to hold a value */
 #define LUA_ERR_CC_INTOVERFLOW 101
@@ -46,6 +46,8 @@ typedef struct Mbuffer {
 #define luaZ_get_base_address(zio) ((const char *)((zio)->reader(NULL, (zio)->data, NULL)))
 #define luaZ_direct_mode(zio) (luaZ_get_base_address(zio) != NULL)
 #define luaZ_get_crt_address(zio) (luaZ_get_base_address(zio) + (zio)->i)
+/* address of the next `len' bytes if the reader's buffer holds all of them */
+#define luaZ_peek(zio,len) ((zio)->n >= (len) ? (zio)->p : NULL)
 
 LUAI_FUNC char *luaZ_openspace (lua_State *L, Mbuffer *buff, size_t n);
 LUAI_FUNC void luaZ_init (lua_State *L, ZIO *z, lua_Reader reader,
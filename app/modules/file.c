@@ -8,10 +8,14 @@
 #include "c_types.h"
 #include "vfs.h"
 #include "c_string.h"
-
-#include <alloca.h>
+#include "c_stdlib.h"
+#ifdef BUILD_SPIFFS
+#include "myspiffs.h"
+#endif
 
 #define FILE_READ_CHUNK 1024
+// size of the read buffer of a file object, allocated on its first read
+#define FILE_READ_BUF 512
 
 // use this time/date in absence of a timestamp
 #define FILE_TIMEDEF_YEAR 1970
@@ -21,14 +25,42 @@
 #define FILE_TIMEDEF_MIN 00
 #define FILE_TIMEDEF_SEC 00
 
-static int file_fd = 0;
 static int file_fd_ref = LUA_NOREF;
 static int rtc_cb_ref = LUA_NOREF;
 
+// Reads go through a buffer, so that a line costs a scan of the buffer
+// rather than a read and a seek back. The file position is ahead of the
+// position seen from Lua by the bytes still buffered; file_sync_rbuf() moves
+// it back before anything else uses the file.
 typedef struct _file_fd_ud {
   int fd;
+  char *rbuf;
+  uint16_t rpos;
+  uint16_t rlen;
 } file_fd_ud;
 
+static void file_sync_rbuf( file_fd_ud *ud )
+{
+  if (ud->rpos < ud->rlen) {
+    vfs_lseek( ud->fd, -(sint32_t)(ud->rlen - ud->rpos), VFS_SEEK_CUR );
+  }
+  ud->rpos = ud->rlen = 0;
+}
+
+static void file_free_ud( lua_State *L, file_fd_ud *ud )
+{
+  if (ud->fd) {
+    vfs_close( ud->fd );
+    // mark as closed
+    ud->fd = 0;
+  }
+  if (ud->rbuf) {
+    luaM_freemem( L, ud->rbuf, FILE_READ_BUF );
+    ud->rbuf = NULL;
+  }
+  ud->rpos = ud->rlen = 0;
+}
+
 static void table2tm( lua_State *L, vfs_time *tm )
 {
   int idx = lua_gettop( L );
@@ -130,22 +162,15 @@ static int file_close( lua_State* L )
   luaL_unref( L, LUA_REGISTRYINDEX, file_fd_ref );
   file_fd_ref = LUA_NOREF;
 
-  if(ud->fd){
-      vfs_close(ud->fd);
-      // mark as closed
-      ud->fd = 0;
-  }
+  file_free_ud( L, ud );
   return 0;  
 }
 
 static int file_obj_free( lua_State *L )
 {
   file_fd_ud *ud = (file_fd_ud *)luaL_checkudata(L, 1, "file.obj");
-  if (ud->fd) {
-    // close file if it's still open
-    vfs_close(ud->fd);
-    ud->fd = 0;
-  }
+  // close file if it's still open
+  file_free_ud( L, ud );
 
   return 0;
 }
@@ -178,6 +203,114 @@ static int file_fscfg (lua_State *L)
   return 2;
 }
 
+// Lua: fsstat()
+static int file_fsstat (lua_State *L)
+{
+  struct vfs_fsstat st;
+
+  if (vfs_fsstat(&st) != VFS_RES_OK) {
+    return luaL_error(L, "file system failed");
+  }
+
+  lua_createtable (L, 0, 5);
+  lua_pushinteger (L, st.cache_hits);
+  lua_setfield (L, -2, "cache_hits");
+  lua_pushinteger (L, st.cache_misses);
+  lua_setfield (L, -2, "cache_misses");
+  lua_pushinteger (L, st.flash_reads);
+  lua_setfield (L, -2, "flash_reads");
+  lua_pushinteger (L, st.flash_writes);
+  lua_setfield (L, -2, "flash_writes");
+  lua_pushinteger (L, st.flash_erases);
+  lua_setfield (L, -2, "flash_erases");
+  return 1;
+}
+
+#ifdef BUILD_SPIFFS
+// Lua: map(filename)
+static int file_map_open (lua_State *L)
+{
+  const char *fname = luaL_checkstring(L, 1);
+  myspiffs_map **ud = (myspiffs_map **)lua_newuserdata(L, sizeof(myspiffs_map *));
+
+  *ud = myspiffs_map_open(fname);
+  if (!*ud) {
+    lua_pushnil(L);
+    return 1;
+  }
+  luaL_getmetatable(L, "file.map");
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+static myspiffs_map *file_map_check (lua_State *L)
+{
+  myspiffs_map **ud = (myspiffs_map **)luaL_checkudata(L, 1, "file.map");
+  luaL_argcheck(L, *ud, 1, "map closed");
+  return *ud;
+}
+
+// Lua: map:read(offset[, len])
+static int file_map_read (lua_State *L)
+{
+  myspiffs_map *m = file_map_check(L);
+  uint32_t size = myspiffs_map_size(m);
+  uint32_t offset = luaL_checkinteger(L, 2);
+  uint32_t len = luaL_optinteger(L, 3, FILE_READ_CHUNK);
+  luaL_Buffer b;
+
+  if (offset >= size) {
+    lua_pushnil(L);
+    return 1;
+  }
+  if (len > size - offset) {
+    len = size - offset;
+  }
+  luaL_buffinit(L, &b);
+  while (len > 0) {
+    uint32_t n = len < LUAL_BUFFERSIZE ? len : LUAL_BUFFERSIZE;
+    n = myspiffs_map_read(m, offset, luaL_prepbuffer(&b), n);
+    luaL_addsize(&b, n);
+    offset += n;
+    len -= n;
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+// Lua: map:byte(offset)
+static int file_map_byte (lua_State *L)
+{
+  myspiffs_map *m = file_map_check(L);
+  uint8_t c;
+
+  if (myspiffs_map_read(m, luaL_checkinteger(L, 2), &c, 1) != 1) {
+    lua_pushnil(L);
+  } else {
+    lua_pushinteger(L, c);
+  }
+  return 1;
+}
+
+// Lua: map:size()
+static int file_map_size (lua_State *L)
+{
+  lua_pushinteger(L, myspiffs_map_size(file_map_check(L)));
+  return 1;
+}
+
+// Lua: map:close()
+static int file_map_close (lua_State *L)
+{
+  myspiffs_map **ud = (myspiffs_map **)luaL_checkudata(L, 1, "file.map");
+  if (*ud) {
+    myspiffs_map_close(*ud);
+    *ud = NULL;
+  }
+  return 0;
+}
+#endif
+
 // Lua: open(filename, mode)
 static int file_open( lua_State* L )
 {
@@ -193,13 +326,15 @@ static int file_open( lua_State* L )
 
   const char *mode = luaL_optstring(L, 2, "r");
 
-  file_fd = vfs_open(fname, mode);
+  int fd = vfs_open(fname, mode);
 
-  if(!file_fd){
+  if(!fd){
     lua_pushnil(L);
   } else {
     file_fd_ud *ud = (file_fd_ud *) lua_newuserdata( L, sizeof( file_fd_ud ) );
-    ud->fd = file_fd;
+    ud->fd = fd;
+    ud->rbuf = NULL;
+    ud->rpos = ud->rlen = 0;
     luaL_getmetatable( L, "file.obj" );
     lua_setmetatable( L, -2 );
 
@@ -228,20 +363,28 @@ static int file_list( lua_State* L )
   return 0;
 }
 
-static int get_file_obj( lua_State *L, int *argpos )
+static file_fd_ud *get_file_obj( lua_State *L, int *argpos )
 {
+  file_fd_ud *ud = NULL;
+
   if (lua_type( L, 1 ) == LUA_TUSERDATA) {
-    file_fd_ud *ud = (file_fd_ud *)luaL_checkudata(L, 1, "file.obj");
+    ud = (file_fd_ud *)luaL_checkudata(L, 1, "file.obj");
     *argpos = 2;
-    return ud->fd;
   } else {
     *argpos = 1;
-    return file_fd;
+    if (file_fd_ref != LUA_NOREF) {
+      // last opened file, kept alive by its reference
+      lua_rawgeti( L, LUA_REGISTRYINDEX, file_fd_ref );
+      ud = (file_fd_ud *)lua_touserdata( L, -1 );
+      lua_pop( L, 1 );
+    }
   }
+  return ud;
 }
 
 #define GET_FILE_OBJ int argpos; \
-  int fd = get_file_obj( L, &argpos );
+  file_fd_ud *ud = get_file_obj( L, &argpos ); \
+  int fd = ud ? ud->fd : 0;
 
 static int file_seek (lua_State *L)
 {
@@ -253,6 +396,7 @@ static int file_seek (lua_State *L)
     return luaL_error(L, "open a file first");
   int op = luaL_checkoption(L, argpos, "cur", modenames);
   long offset = luaL_optlong(L, ++argpos, 0);
+  file_sync_rbuf(ud);
   op = vfs_lseek(fd, offset, mode[op]);
   if (op < 0)
     lua_pushnil(L);  /* error */
@@ -293,6 +437,7 @@ static int file_flush( lua_State* L )
 
   if(!fd)
     return luaL_error(L, "open a file first");
+  file_sync_rbuf(ud);
   if(vfs_flush(fd) == 0)
     lua_pushboolean(L, 1);
   else
@@ -300,6 +445,21 @@ static int file_flush( lua_State* L )
   return 1;
 }
 
+// Lua: expand(size)
+static int file_expand( lua_State* L )
+{
+  GET_FILE_OBJ;
+
+  if(!fd)
+    return luaL_error(L, "open a file first");
+  uint32_t size = luaL_checkinteger(L, argpos);
+  if(vfs_expand(fd, size) == VFS_RES_OK)
+    lua_pushboolean(L, 1);
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
 // Lua: rename("oldname", "newname")
 static int file_rename( lua_State* L )
 {
@@ -384,12 +544,16 @@ static int file_stat( lua_State* L )
 }
 
 // g_read()
-static int file_g_read( lua_State* L, int n, int16_t end_char, int fd )
+static int file_g_read( lua_State* L, int n, int16_t end_char, file_fd_ud *ud )
 {
   static char *heap_mem = NULL;
-  // free leftover memory
+  static size_t heap_len = 0;
+  luaL_Buffer b;
+  int total = 0;
+
+  // free the buffer of a large read that raised an error
   if (heap_mem) {
-    luaM_free(L, heap_mem);
+    luaM_freemem(L, heap_mem, heap_len);
     heap_mem = NULL;
   }
 
@@ -399,48 +563,64 @@ static int file_g_read( lua_State* L, int n, int16_t end_char, int fd )
   if(end_char < 0 || end_char >255)
     end_char = EOF;
 
-
-  if(!fd)
+  if(!ud || !ud->fd)
     return luaL_error(L, "open a file first");
 
-  char *p;
-  int i;
-
-  if (n > LUAL_BUFFERSIZE) {
-    // get buffer from heap
-    p = heap_mem = luaM_malloc(L, n);
-  } else {
-    // small chunks go onto the stack
-    p = alloca(n);
+  if (end_char == EOF && n >= FILE_READ_BUF) {
+    // large reads take what is buffered and go to the file system for the
+    // rest in one piece, so that whole sectors can be transferred at once
+    heap_len = n;
+    heap_mem = (char *)luaM_malloc(L, heap_len);
+    total = ud->rlen - ud->rpos;
+    if (total > n)
+      total = n;
+    if (total > 0) {
+      c_memcpy(heap_mem, ud->rbuf + ud->rpos, total);
+      ud->rpos += total;
+    }
+    if (total < n) {
+      int len = vfs_read(ud->fd, heap_mem + total, n - total);
+      if (len > 0)
+        total += len;
+    }
+    if (total > 0)
+      lua_pushlstring(L, heap_mem, total);
+    luaM_freemem(L, heap_mem, heap_len);
+    heap_mem = NULL;
+    return total > 0 ? 1 : 0;
   }
 
-  n = vfs_read(fd, p, n);
-  // bypass search if no end character provided
-  if (n > 0 && end_char != EOF) {
-    for (i = 0; i < n; ++i)
-      if (p[i] == end_char)
-      {
-        ++i;
-        break;
-      }
-  } else {
-    i = n;
-  }
+  if (!ud->rbuf)
+    ud->rbuf = (char *)luaM_malloc(L, FILE_READ_BUF);
 
-  if (i == 0 || n == VFS_RES_ERR) {
-    if (heap_mem) {
-      luaM_free(L, heap_mem);
-      heap_mem = NULL;
+  luaL_buffinit(L, &b);
+  while (total < n) {
+    int len;
+    if (ud->rpos == ud->rlen) {
+      len = vfs_read(ud->fd, ud->rbuf, FILE_READ_BUF);
+      if (len <= 0)
+        break;
+      ud->rpos = 0;
+      ud->rlen = len;
     }
-    return 0;
-  }
 
-  vfs_lseek(fd, -(n - i), VFS_SEEK_CUR);
-  lua_pushlstring(L, p, i);
-  if (heap_mem) {
-    luaM_free(L, heap_mem);
-    heap_mem = NULL;
+    const char *p = ud->rbuf + ud->rpos;
+    const char *e = NULL;
+    len = ud->rlen - ud->rpos;
+    if (len > n - total)
+      len = n - total;
+    if (end_char != EOF && (e = c_memchr(p, end_char, len)) != NULL)
+      len = e - p + 1;
+    luaL_addlstring(&b, p, len);
+    ud->rpos += len;
+    total += len;
+    if (e)
+      break;
   }
+
+  if (total == 0)
+    return 0;
+  luaL_pushresult(&b);
   return 1;
 }
 
@@ -469,7 +649,7 @@ static int file_read( lua_State* L )
     end_char = (int16_t)end[0];
   }
 
-  return file_g_read(L, need_len, end_char, fd);
+  return file_g_read(L, need_len, end_char, ud);
 }
 
 // Lua: readline()
@@ -477,7 +657,39 @@ static int file_readline( lua_State* L )
 {
   GET_FILE_OBJ;
 
-  return file_g_read(L, FILE_READ_CHUNK, '\n', fd);
+  return file_g_read(L, FILE_READ_CHUNK, '\n', ud);
+}
+
+static int file_lines_iter( lua_State* L )
+{
+  file_fd_ud *ud = (file_fd_ud *)lua_touserdata(L, lua_upvalueindex(1));
+  size_t len;
+
+  if (!ud->fd)
+    return luaL_error(L, "file is already closed");
+  if (!file_g_read(L, FILE_READ_CHUNK, '\n', ud))
+    return 0;
+  // strip the line end
+  const char *line = lua_tolstring(L, -1, &len);
+  if (len > 0 && line[len - 1] == '\n') {
+    lua_pushlstring(L, line, len - 1);
+  }
+  return 1;
+}
+
+// Lua: for line in lines() do ... end
+static int file_lines( lua_State* L )
+{
+  GET_FILE_OBJ;
+
+  if(!fd)
+    return luaL_error(L, "open a file first");
+  if (argpos == 2)
+    lua_pushvalue(L, 1);
+  else
+    lua_rawgeti(L, LUA_REGISTRYINDEX, file_fd_ref);
+  lua_pushcclosure(L, file_lines_iter, 1);
+  return 1;
 }
 
 // Lua: write("string")
@@ -489,6 +701,7 @@ static int file_write( lua_State* L )
     return luaL_error(L, "open a file first");
   size_t l, rl;
   const char *s = luaL_checklstring(L, argpos, &l);
+  file_sync_rbuf(ud);
   rl = vfs_write(fd, s, l);
   if(rl==l)
     lua_pushboolean(L, 1);
@@ -506,6 +719,7 @@ static int file_writeline( lua_State* L )
     return luaL_error(L, "open a file first");
   size_t l, rl;
   const char *s = luaL_checklstring(L, argpos, &l);
+  file_sync_rbuf(ud);
   rl = vfs_write(fd, s, l);
   if(rl==l){
     rl = vfs_write(fd, "\n", 1);
@@ -588,15 +802,30 @@ static const LUA_REG_TYPE file_obj_map[] =
   { LSTRKEY( "close" ),     LFUNCVAL( file_close ) },
   { LSTRKEY( "read" ),      LFUNCVAL( file_read ) },
   { LSTRKEY( "readline" ),  LFUNCVAL( file_readline ) },
+  { LSTRKEY( "lines" ),     LFUNCVAL( file_lines ) },
   { LSTRKEY( "write" ),     LFUNCVAL( file_write ) },
   { LSTRKEY( "writeline" ), LFUNCVAL( file_writeline ) },
   { LSTRKEY( "seek" ),      LFUNCVAL( file_seek ) },
   { LSTRKEY( "flush" ),     LFUNCVAL( file_flush ) },
+  { LSTRKEY( "expand" ),    LFUNCVAL( file_expand ) },
   { LSTRKEY( "__gc" ),      LFUNCVAL( file_obj_free ) },
   { LSTRKEY( "__index" ),   LROVAL( file_obj_map ) },
   { LNILKEY, LNILVAL }
 };
 
+#ifdef BUILD_SPIFFS
+static const LUA_REG_TYPE file_map_map[] =
+{
+  { LSTRKEY( "read" ),      LFUNCVAL( file_map_read ) },
+  { LSTRKEY( "byte" ),      LFUNCVAL( file_map_byte ) },
+  { LSTRKEY( "size" ),      LFUNCVAL( file_map_size ) },
+  { LSTRKEY( "close" ),     LFUNCVAL( file_map_close ) },
+  { LSTRKEY( "__gc" ),      LFUNCVAL( file_map_close ) },
+  { LSTRKEY( "__index" ),   LROVAL( file_map_map ) },
+  { LNILKEY, LNILVAL }
+};
+#endif
+
 static const LUA_REG_TYPE file_vol_map[] =
 {
   { LSTRKEY( "umount" ),   LFUNCVAL( file_vol_umount )},
@@ -616,13 +845,17 @@ static const LUA_REG_TYPE file_map[] = {
   { LSTRKEY( "writeline" ), LFUNCVAL( file_writeline ) },
   { LSTRKEY( "read" ),      LFUNCVAL( file_read ) },
   { LSTRKEY( "readline" ),  LFUNCVAL( file_readline ) },
+  { LSTRKEY( "lines" ),     LFUNCVAL( file_lines ) },
 #ifdef BUILD_SPIFFS
   { LSTRKEY( "format" ),    LFUNCVAL( file_format ) },
   { LSTRKEY( "fscfg" ),     LFUNCVAL( file_fscfg ) },
+  { LSTRKEY( "fsstat" ),    LFUNCVAL( file_fsstat ) },
+  { LSTRKEY( "map" ),       LFUNCVAL( file_map_open ) },
 #endif
   { LSTRKEY( "remove" ),    LFUNCVAL( file_remove ) },
   { LSTRKEY( "seek" ),      LFUNCVAL( file_seek ) },
   { LSTRKEY( "flush" ),     LFUNCVAL( file_flush ) },
+  { LSTRKEY( "expand" ),    LFUNCVAL( file_expand ) },
   { LSTRKEY( "rename" ),    LFUNCVAL( file_rename ) },
   { LSTRKEY( "exists" ),    LFUNCVAL( file_exists ) },  
   { LSTRKEY( "fsinfo" ),    LFUNCVAL( file_fsinfo ) },
@@ -638,6 +871,9 @@ static const LUA_REG_TYPE file_map[] = {
 int luaopen_file( lua_State *L ) {
   luaL_rometatable( L, "file.vol",  (void *)file_vol_map );
   luaL_rometatable( L, "file.obj",  (void *)file_obj_map );
+#ifdef BUILD_SPIFFS
+  luaL_rometatable( L, "file.map",  (void *)file_map_map );
+#endif
   return 0;
 }
 
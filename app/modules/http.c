@@ -10,10 +10,26 @@
 #include "cpu_esp8266.h"
 #include "httpclient.h"
 
-static int http_callback_registry  = LUA_NOREF;
+// Lua callbacks of a request
+typedef struct {
+  int callback_ref;
+  int data_ref;
+} http_request_t;
 
-static void http_callback( char * response, int http_status, char ** full_response_p )
+static void http_data_callback( void * arg, int http_status, const char * data, int len )
 {
+  http_request_t *req = (http_request_t *) arg;
+  lua_State *L = lua_getstate();
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, req->data_ref);
+  lua_pushnumber(L, http_status);
+  lua_pushlstring(L, data, len);
+  lua_call(L, 2, 0);
+}
+
+static void http_callback( void * arg, char * response, int http_status, char ** full_response_p )
+{
+  http_request_t *req = (http_request_t *) arg;
   const char *full_response = full_response_p ? *full_response_p : NULL;
 
 #if defined(HTTPCLIENT_DEBUG_ON)
@@ -26,11 +42,15 @@ static void http_callback( char * response, int http_status, char ** full_respon
     dbg_printf( "response=%s<EOF>\n", response );
   }
 #endif
-  if (http_callback_registry != LUA_NOREF)
-  {
-    lua_State *L = lua_getstate();
+  lua_State *L = lua_getstate();
+  int callback_ref = req->callback_ref;
 
-    lua_rawgeti(L, LUA_REGISTRYINDEX, http_callback_registry);
+  luaL_unref(L, LUA_REGISTRYINDEX, req->data_ref);
+  c_free(req);
+
+  if (callback_ref != LUA_NOREF)
+  {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, callback_ref);
 
     lua_pushnumber(L, http_status);
     if ( http_status != HTTP_STATUS_GENERIC_ERROR && response)
@@ -96,14 +116,49 @@ static void http_callback( char * response, int http_status, char ** full_respon
       *full_response_p = NULL;
     }
 
-    luaL_unref(L, LUA_REGISTRYINDEX, http_callback_registry);
-    http_callback_registry = LUA_NOREF;
+    luaL_unref(L, LUA_REGISTRYINDEX, callback_ref);
 
     lua_call(L, 3, 0); // With 3 arguments and 0 result
   }
+  else if (full_response_p && *full_response_p)
+  {
+    c_free(*full_response_p);
+    *full_response_p = NULL;
+  }
 }
 
-// Lua: http.request( url, method, header, body, function(status, reponse) end )
+// Queue the request, with the callbacks at the given stack indices
+static int http_queue( lua_State *L, const char *url, const char *method, const char *headers, const char *body, int callback, int ondata )
+{
+  http_request_t *req = (http_request_t *) c_malloc(sizeof(http_request_t));
+  if (req == NULL)
+  {
+    return luaL_error( L, "out of memory" );
+  }
+  req->callback_ref = LUA_NOREF;
+  req->data_ref = LUA_NOREF;
+
+  if (lua_type(L, callback) == LUA_TFUNCTION || lua_type(L, callback) == LUA_TLIGHTFUNCTION) {
+    lua_pushvalue(L, callback);  // copy argument (func) to the top of stack
+    req->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (ondata && (lua_type(L, ondata) == LUA_TFUNCTION || lua_type(L, ondata) == LUA_TLIGHTFUNCTION)) {
+    lua_pushvalue(L, ondata);
+    req->data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  if (!http_queue_request(url, method, headers, body, http_callback,
+                          req->data_ref != LUA_NOREF ? http_data_callback : NULL, req))
+  {
+    luaL_unref(L, LUA_REGISTRYINDEX, req->callback_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, req->data_ref);
+    c_free(req);
+    return luaL_error( L, "invalid URL" );
+  }
+  return 0;
+}
+
+// Lua: http.request( url, method, header, body, function(status, reponse) end[, function(status, data) end] )
 static int http_lapi_request( lua_State *L )
 {
   int length;
@@ -127,14 +182,7 @@ static int http_lapi_request( lua_State *L )
     body = luaL_checklstring(L, 4, &length);
   }
 
-  if (lua_type(L, 5) == LUA_TFUNCTION || lua_type(L, 5) == LUA_TLIGHTFUNCTION) {
-    lua_pushvalue(L, 5);  // copy argument (func) to the top of stack
-    luaL_unref(L, LUA_REGISTRYINDEX, http_callback_registry);
-    http_callback_registry = luaL_ref(L, LUA_REGISTRYINDEX);
-  }
-
-  http_request(url, method, headers, body, http_callback, 0);
-  return 0;
+  return http_queue(L, url, method, headers, body, 5, 6);
 }
 
 // Lua: http.post( url, header, body, function(status, reponse) end )
@@ -160,15 +208,7 @@ static int http_lapi_post( lua_State *L )
     body = luaL_checklstring(L, 3, &length);
   }
 
-  if (lua_type(L, 4) == LUA_TFUNCTION || lua_type(L, 4) == LUA_TLIGHTFUNCTION) {
-    lua_pushvalue(L, 4);  // copy argument (func) to the top of stack
-    if (http_callback_registry != LUA_NOREF)
-      luaL_unref(L, LUA_REGISTRYINDEX, http_callback_registry);
-    http_callback_registry = luaL_ref(L, LUA_REGISTRYINDEX);
-  }
-
-  http_post(url, headers, body, http_callback);
-  return 0;
+  return http_queue(L, url, "POST", headers, body, 4, 0);
 }
 
 // Lua: http.put( url, header, body, function(status, reponse) end )
@@ -194,15 +234,7 @@ static int http_lapi_put( lua_State *L )
     body = luaL_checklstring(L, 3, &length);
   }
 
-  if (lua_type(L, 4) == LUA_TFUNCTION || lua_type(L, 4) == LUA_TLIGHTFUNCTION) {
-    lua_pushvalue(L, 4);  // copy argument (func) to the top of stack
-    if (http_callback_registry != LUA_NOREF)
-      luaL_unref(L, LUA_REGISTRYINDEX, http_callback_registry);
-    http_callback_registry = luaL_ref(L, LUA_REGISTRYINDEX);
-  }
-
-  http_put(url, headers, body, http_callback);
-  return 0;
+  return http_queue(L, url, "PUT", headers, body, 4, 0);
 }
 
 // Lua: http.delete( url, header, body, function(status, reponse) end )
@@ -228,15 +260,7 @@ static int http_lapi_delete( lua_State *L )
     body = luaL_checklstring(L, 3, &length);
   }
 
-  if (lua_type(L, 4) == LUA_TFUNCTION || lua_type(L, 4) == LUA_TLIGHTFUNCTION) {
-    lua_pushvalue(L, 4);  // copy argument (func) to the top of stack
-    if (http_callback_registry != LUA_NOREF)
-      luaL_unref(L, LUA_REGISTRYINDEX, http_callback_registry);
-    http_callback_registry = luaL_ref(L, LUA_REGISTRYINDEX);
-  }
-
-  http_delete(url, headers, body, http_callback);
-  return 0;
+  return http_queue(L, url, "DELETE", headers, body, 4, 0);
 }
 
 // Lua: http.get( url, header, function(status, reponse) end )
@@ -257,14 +281,16 @@ static int http_lapi_get( lua_State *L )
     headers = luaL_checklstring(L, 2, &length);
   }
 
-  if (lua_type(L, 3) == LUA_TFUNCTION || lua_type(L, 3) == LUA_TLIGHTFUNCTION) {
-    lua_pushvalue(L, 3);  // copy argument (func) to the top of stack
-    if (http_callback_registry != LUA_NOREF)
-      luaL_unref(L, LUA_REGISTRYINDEX, http_callback_registry);
-    http_callback_registry = luaL_ref(L, LUA_REGISTRYINDEX);
-  }
+  return http_queue(L, url, "GET", headers, NULL, 3, 0);
+}
+
+// Lua: http.keepalive( seconds )
+static int http_lapi_keepalive( lua_State *L )
+{
+  int seconds = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, seconds >= 0 && seconds <= 3600, 1, "out of range");
 
-  http_get(url, headers, http_callback);
+  http_keepalive(seconds * 1000);
   return 0;
 }
 
@@ -275,6 +301,7 @@ static const LUA_REG_TYPE http_map[] = {
   { LSTRKEY( "put" ),             LFUNCVAL( http_lapi_put ) },
   { LSTRKEY( "delete" ),          LFUNCVAL( http_lapi_delete ) },
   { LSTRKEY( "get" ),             LFUNCVAL( http_lapi_get ) },
+  { LSTRKEY( "keepalive" ),       LFUNCVAL( http_lapi_keepalive ) },
 
   { LSTRKEY( "OK" ),              LNUMVAL( 0 ) },
   { LSTRKEY( "ERROR" ),           LNUMVAL( HTTP_STATUS_GENERIC_ERROR ) },
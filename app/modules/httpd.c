@@ -0,0 +1,842 @@
+// Module for a HTTP/1.1 server
+
+#include "module.h"
+#include "lauxlib.h"
+#include "platform.h"
+#include "user_modules.h"
+
+#include "c_string.h"
+#include "c_stdlib.h"
+#include "c_stdio.h"
+
+#include "c_types.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/tcp.h"
+
+#include "net_sendq.h"
+
+#if defined(LUA_USE_MODULES_HTTPD) && !defined(LUA_USE_MODULES_NET)
+#error "The httpd module needs the net module"
+#endif
+
+#define HTTPD_MAX_LINE     512   // longest request or header line
+#define HTTPD_MAX_HEADERS  32
+#define HTTPD_POLL         2     // poll interval in TCP timer ticks, 1s
+#define HTTPD_MAX_CONN     4     // default for connections at a time
+
+#define HTTPD_TABLE_SERVER "httpd.server"
+#define HTTPD_TABLE_CONN   "httpd.conn"
+
+// from the net module
+extern int lwip_lua_checkerr (lua_State *L, err_t err);
+
+typedef struct httpd_server {
+  struct tcp_pcb *pcb;
+  int self_ref;
+  int routes_ref;       // array of {method, path, handler}
+  uint16_t timeout;
+  uint8_t maxconn;
+  uint8_t nconns;       // open connections, which keep the server alive
+} httpd_server;
+
+typedef enum httpd_state {
+  HTTPD_REQUEST_LINE = 0,
+  HTTPD_HEADERS,
+  HTTPD_BODY,
+  HTTPD_DONE            // request read, the response is not finished yet
+} httpd_state;
+
+// A connection, which is also the response object passed to the handlers.
+// The request is parsed a line at a time straight from the pbufs, so a
+// connection needs no more memory than the line buffer and the request
+// table, however long the headers are.
+typedef struct httpd_conn {
+  struct tcp_pcb *pcb;
+  int self_ref;
+  httpd_server *srv;    // with its routes, kept by srv_ref while open
+  int srv_ref;
+  int req_ref;          // request table
+  int hdr_ref;          // response header lines, until the response starts
+  net_sendq sendq;      // strings being sent
+  int sent_ref;         // res:send() callback, called once the queue is written
+  struct pbuf *rx;      // received, not parsed yet
+  uint32_t body_left;
+  uint16_t line_len;
+  uint16_t timeout;
+  uint16_t idle;        // seconds without traffic
+  uint8_t state;
+  uint8_t nheaders;
+  unsigned http10 : 1;
+  unsigned head : 1;        // HEAD request, the body is not sent
+  unsigned keepalive : 1;
+  unsigned chunked : 1;     // the request body is chunked
+  unsigned started : 1;     // status line and headers are queued
+  unsigned streaming : 1;   // the response body is sent in chunks
+  unsigned finished : 1;
+  unsigned closing : 1;     // close once the queue has been written
+  unsigned eof : 1;         // the client has closed its side
+  unsigned busy : 1;        // in httpd_process() or a callback, closing waits
+  char line[HTTPD_MAX_LINE];
+} httpd_conn;
+
+static const char *httpd_reason( int status ) {
+  switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default:  return "";
+  }
+}
+
+#pragma mark - Connections
+
+static err_t httpd_process( httpd_conn *c );
+
+static void httpd_release( httpd_conn *c ) {
+  lua_State *L = lua_getstate();
+  if (c->rx) {
+    pbuf_free(c->rx);
+    c->rx = NULL;
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, c->req_ref);
+  c->req_ref = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, c->hdr_ref);
+  c->hdr_ref = LUA_NOREF;
+  net_sendq_free(&c->sendq);
+  luaL_unref(L, LUA_REGISTRYINDEX, c->sent_ref);
+  c->sent_ref = LUA_NOREF;
+  if (c->srv) {
+    c->srv->nconns--;
+    c->srv = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, c->srv_ref);
+    c->srv_ref = LUA_NOREF;
+  }
+  if (c->state < HTTPD_BODY)
+    c->finished = 1;  // no response pending, res must not be used again
+  c->state = HTTPD_DONE;
+  if (c->self_ref != LUA_NOREF) {
+    lua_gc(L, LUA_GCSTOP, 0);
+    luaL_unref(L, LUA_REGISTRYINDEX, c->self_ref);
+    c->self_ref = LUA_NOREF;
+    lua_gc(L, LUA_GCRESTART, 0);
+  }
+}
+
+static err_t httpd_close( httpd_conn *c ) {
+  err_t err = ERR_OK;
+  if (c->pcb) {
+    tcp_arg(c->pcb, NULL);
+    tcp_recv(c->pcb, NULL);
+    tcp_sent(c->pcb, NULL);
+    tcp_err(c->pcb, NULL);
+    tcp_poll(c->pcb, NULL, 0);
+    // lwIP resets rather than closes a connection with data not passed to
+    // tcp_recved(), and the response still queued would be lost
+    if (c->rx) {
+      tcp_recved(c->pcb, c->rx->tot_len);
+      pbuf_free(c->rx);
+      c->rx = NULL;
+    }
+    if (tcp_close(c->pcb) != ERR_OK) {
+      tcp_abort(c->pcb);
+      err = ERR_ABRT;
+    }
+    c->pcb = NULL;
+  }
+  httpd_release(c);
+  return err;
+}
+
+// Closes the connection once it is due and nothing is left to send. While
+// the connection is busy this is left to httpd_process(), which passes on
+// the ERR_ABRT of an aborted pcb to the lwIP callback.
+static err_t httpd_check_close( httpd_conn *c ) {
+  if (c->pcb && c->closing && !c->busy && c->sendq.ref == LUA_NOREF)
+    return httpd_close(c);
+  return ERR_OK;
+}
+
+// Hands the queue to TCP as far as the send buffer takes it, with the code
+// the net module uses for client:send().
+static err_t httpd_pump( httpd_conn *c ) {
+  if (!c->pcb)
+    return ERR_OK;
+  if (net_sendq_pump(&c->sendq, c->pcb, 0) != ERR_OK)
+    c->closing = 1;
+  else
+    tcp_output(c->pcb);
+  return httpd_check_close(c);
+}
+
+// Calls the res:send() callback once everything queued has been handed to
+// TCP, so the application sends the next part only when the last one no
+// longer takes up heap.
+static void httpd_drained( httpd_conn *c ) {
+  if (!c->pcb || c->closing || c->sent_ref == LUA_NOREF || c->sendq.ref != LUA_NOREF)
+    return;
+  lua_State *L = lua_getstate();
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->sent_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, c->sent_ref);
+  c->sent_ref = LUA_NOREF;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->self_ref);
+  lua_call(L, 1, 0);
+}
+
+#pragma mark - Responses
+
+// Queues the status line and the headers. Without a length the body is
+// sent in chunks, or to a HTTP/1.0 client as it comes, closing the
+// connection after it.
+static void httpd_start( lua_State *L, httpd_conn *c, int status, int length ) {
+  int n = 1;
+  c->started = 1;
+  if (length < 0) {
+    if (c->http10)
+      c->keepalive = 0;
+    else
+      c->streaming = 1;
+  }
+  lua_pushfstring(L, "HTTP/1.1 %d %s\r\n", status, httpd_reason(status));
+  if (c->hdr_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, c->hdr_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, c->hdr_ref);
+    c->hdr_ref = LUA_NOREF;
+    n++;
+  }
+  if (length >= 0) {
+    lua_pushfstring(L, "Content-Length: %d\r\n", length);
+    n++;
+  } else if (c->streaming) {
+    lua_pushliteral(L, "Transfer-Encoding: chunked\r\n");
+    n++;
+  }
+  if (!c->keepalive) {
+    lua_pushliteral(L, "Connection: close\r\n");
+    n++;
+  }
+  lua_pushliteral(L, "\r\n");
+  lua_concat(L, n + 1);
+  net_sendq_push(L, &c->sendq);
+}
+
+// Queues the string at index idx as (a chunk of) the body.
+static void httpd_body_data( lua_State *L, httpd_conn *c, int idx, size_t len ) {
+  if (c->head || len == 0)
+    return;
+  if (c->streaming) {
+    char size[12];
+    c_sprintf(size, "%x\r\n", (unsigned)len);
+    lua_pushstring(L, size);
+    net_sendq_push(L, &c->sendq);
+  }
+  lua_pushvalue(L, idx);
+  net_sendq_push(L, &c->sendq);
+  if (c->streaming) {
+    lua_pushliteral(L, "\r\n");
+    net_sendq_push(L, &c->sendq);
+  }
+}
+
+// The request has been read and answered, get ready for the next one.
+static void httpd_next( httpd_conn *c ) {
+  lua_State *L = lua_getstate();
+  luaL_unref(L, LUA_REGISTRYINDEX, c->req_ref);
+  c->req_ref = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, c->hdr_ref);
+  c->hdr_ref = LUA_NOREF;
+  c->state = HTTPD_REQUEST_LINE;
+  c->nheaders = 0;
+  c->body_left = 0;
+  c->head = c->chunked = c->started = c->streaming = c->finished = 0;
+  if (!c->keepalive)
+    c->closing = 1;
+}
+
+// Answers a request the application does not get to see, and closes.
+static void httpd_error( httpd_conn *c, int status ) {
+  lua_State *L = lua_getstate();
+  c->keepalive = 0;
+  if (!c->started)
+    httpd_start(L, c, status, 0);
+  c->finished = 1;
+  c->state = HTTPD_DONE;
+  c->closing = 1;
+  httpd_pump(c);
+}
+
+static httpd_conn *httpd_check_conn( lua_State *L ) {
+  httpd_conn *c = (httpd_conn *)luaL_checkudata(L, 1, HTTPD_TABLE_CONN);
+  if (c->finished || c->state < HTTPD_BODY)
+    luaL_error(L, "no response pending");
+  return c;
+}
+
+// Lua: res:send_header(name, value)
+static int httpd_res_send_header( lua_State *L ) {
+  httpd_conn *c = httpd_check_conn(L);
+  luaL_checkstring(L, 2);
+  luaL_checkstring(L, 3);
+  if (c->started)
+    return luaL_error(L, "response already started");
+  if (c->hdr_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, c->hdr_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, c->hdr_ref);
+  } else {
+    lua_pushliteral(L, "");
+  }
+  lua_pushvalue(L, 2);
+  lua_pushliteral(L, ": ");
+  lua_pushvalue(L, 3);
+  lua_pushliteral(L, "\r\n");
+  lua_concat(L, 5);
+  c->hdr_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  return 0;
+}
+
+// Lua: res:send(data[, status][, function(res)])
+static int httpd_res_send( lua_State *L ) {
+  httpd_conn *c = httpd_check_conn(L);
+  size_t len = 0;
+  int status = 200, stack = 3;
+  if (!lua_isnoneornil(L, 2))
+    luaL_checklstring(L, 2, &len);
+  if (!lua_isfunction(L, stack) && !lua_islightfunction(L, stack))
+    status = luaL_optinteger(L, stack++, 200);
+  if (!c->pcb)
+    return 0;
+  if (lua_isfunction(L, stack) || lua_islightfunction(L, stack)) {
+    lua_pushvalue(L, stack);
+    luaL_unref(L, LUA_REGISTRYINDEX, c->sent_ref);
+    c->sent_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (!c->started)
+    httpd_start(L, c, status, -1);
+  httpd_body_data(L, c, 2, len);
+  httpd_pump(c);
+  return 0;
+}
+
+// Lua: res:finish([data[, status]])
+static int httpd_res_finish( lua_State *L ) {
+  httpd_conn *c = httpd_check_conn(L);
+  size_t len = 0;
+  if (!lua_isnoneornil(L, 2))
+    luaL_checklstring(L, 2, &len);
+  int status = luaL_optinteger(L, 3, 200);
+  c->finished = 1;
+  luaL_unref(L, LUA_REGISTRYINDEX, c->sent_ref);
+  c->sent_ref = LUA_NOREF;
+  if (!c->pcb)
+    return 0;
+  if (!c->started)
+    httpd_start(L, c, status, len);
+  httpd_body_data(L, c, 2, len);
+  if (c->streaming && !c->head) {
+    lua_pushliteral(L, "0\r\n\r\n");
+    net_sendq_push(L, &c->sendq);
+  }
+  if (!c->keepalive)
+    c->closing = 1;
+  // otherwise the rest of the body is read first
+  if (c->state == HTTPD_DONE)
+    httpd_next(c);
+  httpd_pump(c);
+  // requests pipelined behind this one
+  if (c->pcb && !c->busy)
+    httpd_process(c);
+  return 0;
+}
+
+static int httpd_conn_delete( lua_State *L ) {
+  httpd_conn *c = (httpd_conn *)luaL_checkudata(L, 1, HTTPD_TABLE_CONN);
+  if (c->pcb) {
+    tcp_arg(c->pcb, NULL);
+    tcp_abort(c->pcb);
+    c->pcb = NULL;
+  }
+  httpd_release(c);
+  return 0;
+}
+
+#pragma mark - Request parser
+
+// Case-insensitive check for a token in a comma separated header value.
+static int httpd_has_token( const char *value, const char *token ) {
+  size_t n = c_strlen(token);
+  const char *p = value;
+  while (*p) {
+    while (*p == ' ' || *p == ',') p++;
+    size_t i = 0;
+    while (i < n && p[i] && (p[i] | 0x20) == token[i]) i++;
+    if (i == n && (p[i] == 0 || p[i] == ',' || p[i] == ' ' || p[i] == ';'))
+      return 1;
+    while (*p && *p != ',') p++;
+  }
+  return 0;
+}
+
+static void httpd_request_line( lua_State *L, httpd_conn *c ) {
+  char *method = c->line, *target, *version, *query;
+  if (!(target = c_strchr(method, ' ')) || target == method) {
+    httpd_error(c, 400);
+    return;
+  }
+  *target++ = 0;
+  if (!(version = c_strchr(target, ' ')) || version == target ||
+      c_strncmp(version + 1, "HTTP/1.", 7) != 0) {
+    httpd_error(c, 400);
+    return;
+  }
+  *version++ = 0;
+  c->http10 = version[7] == '0';
+  c->keepalive = !c->http10;
+  c->head = c_strcmp(method, "HEAD") == 0;
+
+  lua_createtable(L, 0, 4);
+  lua_pushstring(L, method);
+  lua_setfield(L, -2, "method");
+  if ((query = c_strchr(target, '?'))) {
+    *query++ = 0;
+    lua_pushstring(L, query);
+    lua_setfield(L, -2, "query");
+  }
+  lua_pushstring(L, target);
+  lua_setfield(L, -2, "path");
+  lua_newtable(L);
+  lua_setfield(L, -2, "headers");
+  c->req_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  c->state = HTTPD_HEADERS;
+}
+
+static void httpd_header( lua_State *L, httpd_conn *c ) {
+  char *name = c->line, *value = c_strchr(name, ':'), *p;
+  if (!value || value == name) {
+    httpd_error(c, 400);
+    return;
+  }
+  if (++c->nheaders > HTTPD_MAX_HEADERS) {
+    httpd_error(c, 431);
+    return;
+  }
+  *value++ = 0;
+  for (p = name; *p; p++)
+    if (*p >= 'A' && *p <= 'Z') *p += 'a' - 'A';
+  while (*value == ' ' || *value == '\t') value++;
+  p = value + c_strlen(value);
+  while (p > value && (p[-1] == ' ' || p[-1] == '\t')) *--p = 0;
+
+  if (c_strcmp(name, "content-length") == 0) {
+    uint32_t n = 0;
+    for (p = value; *p >= '0' && *p <= '9' && n < 100000000; p++)
+      n = n * 10 + *p - '0';
+    if (p == value || *p) {
+      httpd_error(c, 400);
+      return;
+    }
+    c->body_left = n;
+  } else if (c_strcmp(name, "transfer-encoding") == 0) {
+    c->chunked = !httpd_has_token(value, "identity");
+  } else if (c_strcmp(name, "connection") == 0) {
+    if (httpd_has_token(value, "close"))
+      c->keepalive = 0;
+    else if (httpd_has_token(value, "keep-alive"))
+      c->keepalive = 1;
+  } else if (c_strcmp(name, "expect") == 0 && !c->http10 &&
+             httpd_has_token(value, "100-continue")) {
+    lua_pushliteral(L, "HTTP/1.1 100 Continue\r\n\r\n");
+    net_sendq_push(L, &c->sendq);
+    httpd_pump(c);
+  }
+
+  // a repeated header is joined to the first one
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->req_ref);
+  lua_getfield(L, -1, "headers");
+  lua_getfield(L, -1, name);
+  if (lua_isstring(L, -1)) {
+    lua_pushliteral(L, ", ");
+    lua_pushstring(L, value);
+    lua_concat(L, 3);
+  } else {
+    lua_pop(L, 1);
+    lua_pushstring(L, value);
+  }
+  lua_setfield(L, -2, name);
+  lua_pop(L, 2);
+}
+
+// Pushes the handler of the first route matching the request.
+static int httpd_find_route( lua_State *L, httpd_conn *c ) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->req_ref);
+  lua_getfield(L, -1, "method");
+  lua_getfield(L, -2, "path");
+  const char *method = lua_tostring(L, -2), *path = lua_tostring(L, -1);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->srv->routes_ref);
+  int i, n = lua_objlen(L, -1);
+  for (i = 1; i <= n; i++) {
+    size_t pl;
+    lua_rawgeti(L, -1, i);
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    const char *m = lua_tostring(L, -2), *p = lua_tolstring(L, -1, &pl);
+    // a path ending in '*' matches any path starting with the rest
+    int match = (c_strcmp(m, "*") == 0 || c_strcmp(m, method) == 0) &&
+                (pl > 0 && p[pl - 1] == '*' ? c_strncmp(p, path, pl - 1) == 0
+                                            : c_strcmp(p, path) == 0);
+    lua_pop(L, 2);
+    if (match) {
+      lua_rawgeti(L, -1, 3);
+      lua_replace(L, -6);
+      lua_pop(L, 4);
+      return 1;
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 4);
+  return 0;
+}
+
+// Calls req.ondata(req, data), or with nil at the end of the body.
+static void httpd_ondata( lua_State *L, httpd_conn *c, const char *data, size_t len ) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->req_ref);
+  lua_getfield(L, -1, "ondata");
+  if (!lua_isfunction(L, -1) && !lua_islightfunction(L, -1)) {
+    lua_pop(L, 2);
+    return;
+  }
+  lua_insert(L, -2);
+  if (data)
+    lua_pushlstring(L, data, len);
+  else
+    lua_pushnil(L);
+  lua_call(L, 2, 0);
+}
+
+static void httpd_body_end( lua_State *L, httpd_conn *c ) {
+  c->state = HTTPD_DONE;
+  if (c->finished)
+    httpd_next(c);
+  else
+    httpd_ondata(L, c, NULL, 0);
+}
+
+static void httpd_headers_done( lua_State *L, httpd_conn *c ) {
+  if (c->chunked) {
+    httpd_error(c, 501);
+    return;
+  }
+  if (!httpd_find_route(L, c)) {
+    httpd_error(c, 404);
+    return;
+  }
+  c->state = HTTPD_BODY;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->req_ref);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, c->self_ref);
+  lua_call(L, 2, 0);
+  if (c->pcb && c->state == HTTPD_BODY && c->body_left == 0)
+    httpd_body_end(L, c);
+}
+
+// Drops n bytes from the first pbuf, and opens the window by as much.
+static void httpd_consume( httpd_conn *c, u16_t n ) {
+  struct pbuf *p = c->rx;
+  if (n == p->len) {
+    c->rx = p->next;
+    if (c->rx) pbuf_ref(c->rx);
+    pbuf_free(p);
+  } else {
+    pbuf_header(p, -(s16_t)n);
+  }
+  if (n)
+    tcp_recved(c->pcb, n);
+}
+
+// Parses what has been received while there is no response pending. Data
+// arriving in the meantime, such as a pipelined request, stays in the pbufs
+// and is not acknowledged, so a client is held back by the TCP window.
+static err_t httpd_process( httpd_conn *c ) {
+  lua_State *L = lua_getstate();
+  if (c->busy)
+    return ERR_OK;
+  c->busy = 1;
+  while (c->pcb && c->rx && !c->closing && c->state != HTTPD_DONE) {
+    const char *data = (const char *)c->rx->payload;
+    u16_t len = c->rx->len, i = 0;
+    while (i < len && c->pcb && !c->closing && c->state != HTTPD_DONE) {
+      if (c->state == HTTPD_BODY) {
+        u16_t n = len - i;
+        if (n > c->body_left) n = c->body_left;
+        c->body_left -= n;
+        if (!c->finished)
+          httpd_ondata(L, c, data + i, n);
+        i += n;
+        if (c->pcb && c->body_left == 0)
+          httpd_body_end(L, c);
+        continue;
+      }
+      char ch = data[i++];
+      if (ch != '\n') {
+        if (c->line_len < HTTPD_MAX_LINE - 1)
+          c->line[c->line_len++] = ch;
+        else
+          httpd_error(c, c->state == HTTPD_REQUEST_LINE ? 414 : 431);
+        continue;
+      }
+      if (c->line_len > 0 && c->line[c->line_len - 1] == '\r')
+        c->line_len--;
+      c->line[c->line_len] = 0;
+      u16_t line_len = c->line_len;
+      c->line_len = 0;
+      if (c->state == HTTPD_REQUEST_LINE) {
+        if (line_len > 0)   // blank lines between requests are ignored
+          httpd_request_line(L, c);
+      } else if (line_len > 0) {
+        httpd_header(L, c);
+      } else {
+        httpd_headers_done(L, c);
+      }
+    }
+    if (!c->pcb)
+      break;
+    httpd_consume(c, i);
+  }
+  // after the client's FIN, answer what it sent and close once that is done
+  if (c->pcb && c->eof && !c->rx && (c->state < HTTPD_BODY || c->finished))
+    c->closing = 1;
+  c->busy = 0;
+  return httpd_check_close(c);
+}
+
+#pragma mark - LWIP callbacks
+
+static void httpd_err_cb( void *arg, err_t err ) {
+  httpd_conn *c = (httpd_conn *)arg;
+  if (!c) return;
+  c->pcb = NULL; // Will be freed at LWIP level
+  httpd_release(c);
+}
+
+static err_t httpd_recv_cb( void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err ) {
+  httpd_conn *c = (httpd_conn *)arg;
+  if (!c || !c->pcb) {
+    if (p) pbuf_free(p);
+    return ERR_ABRT;
+  }
+  c->idle = 0;
+  if (!p) {
+    c->eof = 1;
+    return httpd_process(c);
+  }
+  if (c->closing) {
+    tcp_recved(tpcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+  if (c->rx)
+    pbuf_cat(c->rx, p);
+  else
+    c->rx = p;
+  return httpd_process(c);
+}
+
+static err_t httpd_sent_cb( void *arg, struct tcp_pcb *tpcb, u16_t len ) {
+  httpd_conn *c = (httpd_conn *)arg;
+  if (!c || !c->pcb) return ERR_ABRT;
+  c->idle = 0;
+  // the res:send() callback may finish the response, and httpd_process()
+  // then answers a pipelined request and closes if that is due
+  c->busy = 1;
+  httpd_pump(c);
+  httpd_drained(c);
+  c->busy = 0;
+  return httpd_process(c);
+}
+
+static err_t httpd_poll_cb( void *arg, struct tcp_pcb *tpcb ) {
+  httpd_conn *c = (httpd_conn *)arg;
+  if (!c || !c->pcb) return ERR_OK;
+  // clients are only timed out while no response is pending
+  if (c->timeout && ++c->idle >= c->timeout &&
+      c->state != HTTPD_DONE && c->sendq.ref == LUA_NOREF)
+    return httpd_close(c);
+  // TCP may have been out of memory with nothing in flight, and a send()
+  // that queued nothing, e.g. for a HEAD request, gets no ack
+  c->busy = 1;
+  httpd_pump(c);
+  httpd_drained(c);
+  c->busy = 0;
+  return httpd_process(c);
+}
+
+static err_t httpd_accept_cb( void *arg, struct tcp_pcb *newpcb, err_t err ) {
+  httpd_server *srv = (httpd_server *)arg;
+  // refused once the server has as many connections as it takes, the client
+  // can try again later
+  if (!srv || !srv->pcb || srv->self_ref == LUA_NOREF ||
+      srv->nconns >= srv->maxconn) {
+    tcp_abort(newpcb);
+    return ERR_ABRT;
+  }
+
+  lua_State *L = lua_getstate();
+  httpd_conn *c = (httpd_conn *)lua_newuserdata(L, sizeof(httpd_conn));
+  c_memset(c, 0, sizeof(httpd_conn));
+  c->req_ref = c->hdr_ref = c->sent_ref = LUA_NOREF;
+  net_sendq_init(&c->sendq);
+  luaL_getmetatable(L, HTTPD_TABLE_CONN);
+  lua_setmetatable(L, -2);
+  c->self_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, srv->self_ref);
+  c->srv_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  c->srv = srv;
+  srv->nconns++;
+  c->timeout = srv->timeout;
+
+  c->pcb = newpcb;
+  tcp_arg(newpcb, c);
+  tcp_recv(newpcb, httpd_recv_cb);
+  tcp_sent(newpcb, httpd_sent_cb);
+  tcp_err(newpcb, httpd_err_cb);
+  tcp_poll(newpcb, httpd_poll_cb, HTTPD_POLL);
+  tcp_accepted(srv->pcb);
+  return ERR_OK;
+}
+
+#pragma mark - Server
+
+// Lua: server = httpd.createServer(port[, timeout[, maxconn]])
+static int httpd_create_server( lua_State *L ) {
+  int port = luaL_checkinteger(L, 1);
+  int timeout = luaL_optinteger(L, 2, 10);
+  int maxconn = luaL_optinteger(L, 3, HTTPD_MAX_CONN);
+  luaL_argcheck(L, port > 0 && port < 65536, 1, "invalid port");
+  luaL_argcheck(L, timeout >= 0 && timeout <= 28800, 2, "wrong arg range");
+  luaL_argcheck(L, maxconn > 0 && maxconn <= 255, 3, "wrong arg range");
+
+  httpd_server *srv = (httpd_server *)lua_newuserdata(L, sizeof(httpd_server));
+  srv->pcb = NULL;
+  srv->self_ref = LUA_NOREF;
+  srv->routes_ref = LUA_NOREF;
+  srv->timeout = timeout;
+  srv->maxconn = maxconn;
+  srv->nconns = 0;
+  luaL_getmetatable(L, HTTPD_TABLE_SERVER);
+  lua_setmetatable(L, -2);
+  lua_newtable(L);
+  srv->routes_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  struct tcp_pcb *pcb = tcp_new();
+  if (!pcb)
+    return luaL_error(L, "cannot allocate PCB");
+  pcb->so_options |= SOF_REUSEADDR;
+  err_t err = tcp_bind(pcb, IP_ADDR_ANY, port);
+  if (err == ERR_OK) {
+    tcp_arg(pcb, srv);
+    struct tcp_pcb *lpcb = tcp_listen(pcb);
+    if (!lpcb) {
+      err = ERR_MEM;
+    } else {
+      pcb = lpcb;
+      tcp_accept(pcb, httpd_accept_cb);
+    }
+  }
+  if (err != ERR_OK) {
+    tcp_close(pcb);
+    return lwip_lua_checkerr(L, err);
+  }
+  srv->pcb = pcb;
+  lua_pushvalue(L, -1);
+  srv->self_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  return 1;
+}
+
+// Lua: server:route(method, path, function(req, res))
+static int httpd_server_route( lua_State *L ) {
+  httpd_server *srv = (httpd_server *)luaL_checkudata(L, 1, HTTPD_TABLE_SERVER);
+  luaL_checkstring(L, 2);
+  luaL_checkstring(L, 3);
+  luaL_checkanyfunction(L, 4);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, srv->routes_ref);
+  lua_createtable(L, 3, 0);
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, -2, 1);
+  lua_pushvalue(L, 3);
+  lua_rawseti(L, -2, 2);
+  lua_pushvalue(L, 4);
+  lua_rawseti(L, -2, 3);
+  lua_rawseti(L, -2, lua_objlen(L, -2) + 1);
+  return 0;
+}
+
+// Lua: server:close()
+static int httpd_server_close( lua_State *L ) {
+  httpd_server *srv = (httpd_server *)luaL_checkudata(L, 1, HTTPD_TABLE_SERVER);
+  if (srv->pcb) {
+    tcp_arg(srv->pcb, NULL);
+    tcp_close(srv->pcb);
+    srv->pcb = NULL;
+  }
+  if (srv->self_ref != LUA_NOREF) {
+    lua_gc(L, LUA_GCSTOP, 0);
+    luaL_unref(L, LUA_REGISTRYINDEX, srv->self_ref);
+    srv->self_ref = LUA_NOREF;
+    lua_gc(L, LUA_GCRESTART, 0);
+  }
+  return 0;
+}
+
+static int httpd_server_delete( lua_State *L ) {
+  httpd_server *srv = (httpd_server *)luaL_checkudata(L, 1, HTTPD_TABLE_SERVER);
+  httpd_server_close(L);
+  luaL_unref(L, LUA_REGISTRYINDEX, srv->routes_ref);
+  srv->routes_ref = LUA_NOREF;
+  return 0;
+}
+
+#pragma mark - Tables
+
+static const LUA_REG_TYPE httpd_server_map[] = {
+  { LSTRKEY( "route" ),   LFUNCVAL( httpd_server_route ) },
+  { LSTRKEY( "close" ),   LFUNCVAL( httpd_server_close ) },
+  { LSTRKEY( "__gc" ),    LFUNCVAL( httpd_server_delete ) },
+  { LSTRKEY( "__index" ), LROVAL( httpd_server_map ) },
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE httpd_conn_map[] = {
+  { LSTRKEY( "send_header" ), LFUNCVAL( httpd_res_send_header ) },
+  { LSTRKEY( "send" ),        LFUNCVAL( httpd_res_send ) },
+  { LSTRKEY( "finish" ),      LFUNCVAL( httpd_res_finish ) },
+  { LSTRKEY( "__gc" ),        LFUNCVAL( httpd_conn_delete ) },
+  { LSTRKEY( "__index" ),     LROVAL( httpd_conn_map ) },
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE httpd_map[] = {
+  { LSTRKEY( "createServer" ), LFUNCVAL( httpd_create_server ) },
+  { LNILKEY, LNILVAL }
+};
+
+int luaopen_httpd( lua_State *L ) {
+  luaL_rometatable(L, HTTPD_TABLE_SERVER, (void *)httpd_server_map);
+  luaL_rometatable(L, HTTPD_TABLE_CONN, (void *)httpd_conn_map);
+  return 0;
+}
+
+NODEMCU_MODULE(HTTPD, "httpd", httpd_map, luaopen_httpd);
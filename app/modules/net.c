@@ -17,6 +17,9 @@
 #include "lwip/igmp.h"
 #include "lwip/tcp.h"
 #include "lwip/udp.h"
+#include "vfs.h"
+
+#include "net_sendq.h"
 
 #if defined(CLIENT_SSL_ENABLE) && defined(LUA_USE_MODULES_NET) && defined(LUA_USE_MODULES_TLS)
 #define TLS_MODULE_PRESENT
@@ -38,10 +41,26 @@ static const net_table_name NET_TABLES[] = {
 #define NET_TABLE_TCP_SERVER NET_TABLES[0]
 #define NET_TABLE_TCP_CLIENT NET_TABLES[1]
 #define NET_TABLE_UDP_SOCKET NET_TABLES[2]
+#define NET_TABLE_TCP_BUFFER "net.tcpbuffer"
 
 #define TYPE_TCP TYPE_TCP_CLIENT
 #define TYPE_UDP TYPE_UDP_SOCKET
 
+#define NET_POLL 2   // send retry interval in TCP timer ticks, 1s
+
+// file being sent by client:sendfile()
+typedef struct lnet_sendfile {
+  int fd;
+  uint32_t left;
+  char buf[TCP_MSS];
+} lnet_sendfile;
+
+// data received by a client in pull mode, see client:on("data")
+typedef struct lnet_rxbuf {
+  struct pbuf *p;
+  struct lnet_userdata *ud;   // NULL once the socket is gone
+} lnet_rxbuf;
+
 typedef struct lnet_userdata {
   enum net_type type;
   int self_ref;
@@ -65,6 +84,12 @@ typedef struct lnet_userdata {
       int cb_connect_ref;
       int cb_disconnect_ref;
       int cb_reconnect_ref;
+      lnet_sendfile *sendfile;
+      net_sendq sendq;    // strings queued by send()
+      int sent_pending;   // "sent" is due once the queue has been written
+      int cb_data_ref;
+      int rxbuf_ref;
+      lnet_rxbuf *rxbuf;
     } client;
   };
 } lnet_userdata;
@@ -112,6 +137,12 @@ lnet_userdata *net_create( lua_State *L, enum net_type type ) {
       ud->client.cb_reconnect_ref = LUA_NOREF;
       ud->client.cb_disconnect_ref = LUA_NOREF;
       ud->client.hold = 0;
+      ud->client.sendfile = NULL;
+      net_sendq_init(&ud->client.sendq);
+      ud->client.sent_pending = 0;
+      ud->client.cb_data_ref = LUA_NOREF;
+      ud->client.rxbuf_ref = LUA_NOREF;
+      ud->client.rxbuf = NULL;
     case TYPE_UDP_SOCKET:
       ud->client.wait_dns = 0;
       ud->client.cb_dns_ref = LUA_NOREF;
@@ -125,12 +156,136 @@ lnet_userdata *net_create( lua_State *L, enum net_type type ) {
   return ud;
 }
 
+#pragma mark - Send queue
+
+void net_sendq_init( net_sendq *q ) {
+  q->ref = LUA_NOREF;
+  q->head = q->tail = 0;
+  q->off = 0;
+}
+
+void net_sendq_free( net_sendq *q ) {
+  if (q->ref != LUA_NOREF)
+    luaL_unref(lua_getstate(), LUA_REGISTRYINDEX, q->ref);
+  net_sendq_init(q);
+}
+
+// Appends the string on top of the stack, and pops it.
+void net_sendq_push( lua_State *L, net_sendq *q ) {
+  if (q->ref == LUA_NOREF) {
+    lua_newtable(L);
+    q->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, q->ref);
+  lua_insert(L, -2);
+  lua_rawseti(L, -2, q->tail++);
+  lua_pop(L, 1);
+}
+
+// Hands the queue to TCP, as much as the send buffer takes. Acks make room
+// for more. more says that other data follows the queue. The queue is freed
+// once it has been written, or on an error. The caller calls tcp_output().
+err_t net_sendq_pump( net_sendq *q, struct tcp_pcb *pcb, int more ) {
+  err_t err = ERR_OK;
+  if (q->ref == LUA_NOREF)
+    return ERR_OK;
+  lua_State *L = lua_getstate();
+  lua_rawgeti(L, LUA_REGISTRYINDEX, q->ref);
+  while (q->head < q->tail) {
+    size_t room = tcp_sndbuf(pcb), len;
+    if (room == 0) break;
+    lua_rawgeti(L, -1, q->head);
+    const char *data = lua_tolstring(L, -1, &len);
+    lua_pop(L, 1);  // still referenced by the queue
+    size_t n = len - q->off;
+    if (n > room) n = room;
+    int follows = q->off + n < len || q->head + 1 < q->tail || more;
+    err = tcp_write(pcb, data + q->off, n,
+                    TCP_WRITE_FLAG_COPY | (follows ? TCP_WRITE_FLAG_MORE : 0));
+    if (err == ERR_MEM) {
+      // too many segments queued, go on with the next ack or poll
+      err = ERR_OK;
+      break;
+    }
+    if (err != ERR_OK) break;
+    q->off += n;
+    if (q->off == len) {
+      lua_pushnil(L);
+      lua_rawseti(L, -2, q->head++);
+      q->off = 0;
+    }
+  }
+  lua_pop(L, 1);
+  if (err != ERR_OK || q->head == q->tail)
+    net_sendq_free(q);
+  return err;
+}
+
+static void net_sendfile_free( lnet_userdata *ud ) {
+  if (ud->client.sendfile) {
+    vfs_close(ud->client.sendfile->fd);
+    c_free(ud->client.sendfile);
+    ud->client.sendfile = NULL;
+  }
+}
+
+// Queues as much of the file as the send buffer takes, read a segment at a
+// time into sf->buf and copied from there by TCP. The rest follows from
+// net_sent_cb.
+static err_t net_sendfile_pump( lnet_userdata *ud ) {
+  lnet_sendfile *sf = ud->client.sendfile;
+  err_t err = ERR_OK;
+  while (sf->left > 0 && tcp_sndbuf(ud->tcp_pcb) > 0) {
+    uint32_t n = sf->left;
+    if (n > tcp_sndbuf(ud->tcp_pcb)) n = tcp_sndbuf(ud->tcp_pcb);
+    if (n > sizeof(sf->buf)) n = sizeof(sf->buf);
+    sint32_t got = vfs_read(sf->fd, sf->buf, n);
+    if (got <= 0) {
+      // file is shorter than expected, send what there was
+      sf->left = 0;
+      break;
+    }
+    err = tcp_write(ud->tcp_pcb, sf->buf, got,
+                    TCP_WRITE_FLAG_COPY | (sf->left > got ? TCP_WRITE_FLAG_MORE : 0));
+    if (err == ERR_MEM) {
+      // send queue is full, read this piece again on the next ack or poll
+      vfs_lseek(sf->fd, -got, VFS_SEEK_CUR);
+      err = ERR_OK;
+      break;
+    }
+    if (err != ERR_OK) break;
+    sf->left -= got;
+  }
+  return err;
+}
+
+static err_t net_poll_cb(void *arg, struct tcp_pcb *tpcb);
+
+// Hands the queued strings to TCP, and then the file of a sendfile(). Acks
+// make room for more, see net_sent_cb.
+static err_t net_tcp_pump( lnet_userdata *ud ) {
+  err_t err = net_sendq_pump(&ud->client.sendq, ud->tcp_pcb, ud->client.sendfile != NULL);
+  if (err == ERR_OK && ud->client.sendq.ref == LUA_NOREF &&
+      ud->client.sendfile && ud->client.sendfile->left > 0)
+    err = net_sendfile_pump(ud);
+  if (err == ERR_OK)
+    tcp_output(ud->tcp_pcb);
+  // TCP may have been out of memory with nothing in flight, and then no ack
+  // comes to go on with the rest
+  if (err == ERR_OK && (ud->client.sendq.ref != LUA_NOREF ||
+      (ud->client.sendfile && ud->client.sendfile->left > 0)))
+    tcp_poll(ud->tcp_pcb, net_poll_cb, NET_POLL);
+  return err;
+}
+
 #pragma mark - LWIP callbacks
 
 static void net_err_cb(void *arg, err_t err) {
   lnet_userdata *ud = (lnet_userdata*)arg;
   if (!ud || ud->type != TYPE_TCP_CLIENT || ud->self_ref == LUA_NOREF) return;
   ud->pcb = NULL; // Will be freed at LWIP level
+  net_sendq_free(&ud->client.sendq);
+  net_sendfile_free(ud);
   lua_State *L = lua_getstate();
   int ref;
   if (err != ERR_OK && ud->client.cb_reconnect_ref != LUA_NOREF)
@@ -245,6 +400,20 @@ static err_t net_tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, er
     net_err_cb(arg, err);
     return tcp_close(tpcb);
   }
+  if (ud->client.cb_data_ref != LUA_NOREF) {
+    // pull mode: keep the pbufs, the window opens as they are consumed
+    lnet_rxbuf *rb = ud->client.rxbuf;
+    if (rb->p)
+      pbuf_cat(rb->p, p);
+    else
+      rb->p = p;
+    lua_State *L = lua_getstate();
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.cb_data_ref);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->self_ref);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.rxbuf_ref);
+    lua_call(L, 2, 0);
+    return ERR_OK;
+  }
   net_recv_cb(ud, p, 0, 0);
   tcp_recved(tpcb, ud->client.hold ? 0 : TCP_WND);
   return ERR_OK;
@@ -253,6 +422,29 @@ static err_t net_tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, er
 static err_t net_sent_cb(void *arg, struct tcp_pcb *tpcb, u16_t len) {
   lnet_userdata *ud = (lnet_userdata*)arg;
   if (!ud || !ud->pcb || ud->type != TYPE_TCP_CLIENT || ud->self_ref == LUA_NOREF) return ERR_ABRT;
+  err_t err = net_tcp_pump(ud);
+  if (err != ERR_OK) {
+    // the rest cannot be sent, drop the connection and report err through
+    // the "reconnection" or "disconnection" callback
+    tcp_arg(tpcb, NULL);
+    tcp_abort(tpcb);
+    net_err_cb(ud, err);
+    return ERR_ABRT;
+  }
+  // the "sent" callback fires once the queue has been written
+  if (ud->client.sendq.ref != LUA_NOREF)
+    return ERR_OK;
+  if (ud->client.sendfile) {
+    // and a file once it has been acknowledged entirely
+    if (ud->client.sendfile->left > 0)
+      return ERR_OK;
+    if (tpcb->unsent || tpcb->unacked)
+      return ERR_OK;
+    net_sendfile_free(ud);
+  }
+  // only once for what was sent, not again on later acks
+  if (!ud->client.sent_pending) return ERR_OK;
+  ud->client.sent_pending = 0;
   if (ud->client.cb_sent_ref == LUA_NOREF) return ERR_OK;
   lua_State *L = lua_getstate();
   lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.cb_sent_ref);
@@ -261,6 +453,16 @@ static err_t net_sent_cb(void *arg, struct tcp_pcb *tpcb, u16_t len) {
   return ERR_OK;
 }
 
+static err_t net_poll_cb(void *arg, struct tcp_pcb *tpcb) {
+  lnet_userdata *ud = (lnet_userdata*)arg;
+  if (!ud || !ud->pcb || ud->type != TYPE_TCP_CLIENT || ud->self_ref == LUA_NOREF) return ERR_OK;
+  if (ud->client.sendq.ref == LUA_NOREF && !ud->client.sendfile) {
+    tcp_poll(tpcb, NULL, 0);
+    return ERR_OK;
+  }
+  return net_sent_cb(arg, tpcb, 0);
+}
+
 static err_t net_accept_cb(void *arg, struct tcp_pcb *newpcb, err_t err) {
   lnet_userdata *ud = (lnet_userdata*)arg;
   if (!ud || ud->type != TYPE_TCP_SERVER || !ud->pcb) return ERR_ABRT;
@@ -489,6 +691,20 @@ int net_connect( lua_State *L ) {
   return 0;
 }
 
+// Lets go of the receive buffer of a socket. It may live on, and keeps the
+// data not consumed yet, which is acknowledged to the peer nonetheless.
+static void net_rxbuf_release( lua_State *L, lnet_userdata *ud ) {
+  lnet_rxbuf *rb = ud->client.rxbuf;
+  if (!rb)
+    return;
+  if (rb->p && ud->tcp_pcb)
+    tcp_recved(ud->tcp_pcb, rb->p->tot_len);
+  rb->ud = NULL;
+  ud->client.rxbuf = NULL;
+  luaL_unref(L, LUA_REGISTRYINDEX, ud->client.rxbuf_ref);
+  ud->client.rxbuf_ref = LUA_NOREF;
+}
+
 // Lua: client/socket:on(name, callback)
 int net_on( lua_State *L ) {
   lnet_userdata *ud = net_get_udata(L);
@@ -505,6 +721,8 @@ int net_on( lua_State *L ) {
         { refptr = &ud->client.cb_disconnect_ref; break; }
       if (strcmp("reconnection",name)==0)
         { refptr = &ud->client.cb_reconnect_ref; break; }
+      if (strcmp("data",name)==0)
+        { refptr = &ud->client.cb_data_ref; break; }
     case TYPE_UDP_SOCKET:
       if (strcmp("dns",name)==0)
         { refptr = &ud->client.cb_dns_ref; break; }
@@ -527,10 +745,24 @@ int net_on( lua_State *L ) {
   } else {
     return luaL_error(L, "invalid callback function");
   }
+  // the receive buffer exists only while there is a "data" callback
+  if (refptr == &ud->client.cb_data_ref) {
+    if (*refptr != LUA_NOREF && !ud->client.rxbuf) {
+      lnet_rxbuf *rb = (lnet_rxbuf *)lua_newuserdata(L, sizeof(lnet_rxbuf));
+      rb->p = NULL;
+      rb->ud = ud;
+      luaL_getmetatable(L, NET_TABLE_TCP_BUFFER);
+      lua_setmetatable(L, -2);
+      ud->client.rxbuf_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+      ud->client.rxbuf = rb;
+    } else if (*refptr == LUA_NOREF) {
+      net_rxbuf_release(L, ud);
+    }
+  }
   return 0;
 }
 
-// Lua: client:send(data, function(c)), socket:send(port, ip, data, function(s))
+// Lua: client:send(data, ..., function(c)), socket:send(port, ip, data, function(s))
 int net_send( lua_State *L ) {
   lnet_userdata *ud = net_get_udata(L);
   if (!ud || ud->type == TYPE_TCP_SERVER)
@@ -548,8 +780,15 @@ int net_send( lua_State *L ) {
     if (!domain) return luaL_error(L, "need IP address");
     if (!ipaddr_aton(domain, &addr)) return luaL_error(L, "invalid IP address");
   }
+  int first = stack;
   data = luaL_checklstring(L, stack++, &datalen);
   if (!data || datalen == 0) return luaL_error(L, "no data to send");
+  if (ud->type == TYPE_TCP_CLIENT) {
+    while (lua_type(L, stack) == LUA_TSTRING)
+      stack++;
+    if (ud->client.sendfile)
+      return luaL_error(L, "sendfile in progress");
+  }
   if (lua_isfunction(L, stack) || lua_islightfunction(L, stack)) {
     lua_pushvalue(L, stack++);
     luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_sent_ref);
@@ -588,7 +827,67 @@ int net_send( lua_State *L ) {
       lua_call(L, 1, 0);
     }
   } else if (ud->type == TYPE_TCP_CLIENT) {
-    err = tcp_write(ud->tcp_pcb, data, datalen, TCP_WRITE_FLAG_COPY);
+    for (int i = first; i < stack; i++) {
+      if (lua_objlen(L, i) == 0) continue;
+      lua_pushvalue(L, i);
+      net_sendq_push(L, &ud->client.sendq);
+    }
+    ud->client.sent_pending = 1;
+    err = net_tcp_pump(ud);
+    if (err != ERR_OK)
+      ud->client.sent_pending = 0;
+  }
+  return lwip_lua_checkerr(L, err);
+}
+
+// Lua: client:sendfile(filename[, offset[, length]][, function(c)])
+int net_sendfile( lua_State *L ) {
+  lnet_userdata *ud = net_get_udata(L);
+  if (!ud || ud->type != TYPE_TCP_CLIENT)
+    return luaL_error(L, "invalid user data");
+  const char *fname = luaL_checkstring(L, 2);
+  int stack = 3;
+  uint32_t offset = 0, length = 0xFFFFFFFF;
+  if (lua_isnumber(L, stack)) {
+    offset = luaL_checkinteger(L, stack++);
+    if (lua_isnumber(L, stack))
+      length = luaL_checkinteger(L, stack++);
+  }
+  if (lua_isfunction(L, stack) || lua_islightfunction(L, stack)) {
+    lua_pushvalue(L, stack++);
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_sent_ref);
+    ud->client.cb_sent_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (!ud->pcb || ud->self_ref == LUA_NOREF)
+    return luaL_error(L, "not connected");
+  if (ud->client.sendfile)
+    return luaL_error(L, "sendfile in progress");
+
+  int fd = vfs_open(fname, "r");
+  if (!fd)
+    return luaL_error(L, "cannot open %s", fname);
+  uint32_t size = vfs_size(fd);
+  if (offset > size) offset = size;
+  if (length > size - offset) length = size - offset;
+  if (length == 0 || vfs_lseek(fd, offset, VFS_SEEK_SET) < 0) {
+    vfs_close(fd);
+    return luaL_error(L, "no data to send");
+  }
+  lnet_sendfile *sf = (lnet_sendfile *)c_malloc(sizeof(lnet_sendfile));
+  if (!sf) {
+    vfs_close(fd);
+    return luaL_error(L, "out of memory");
+  }
+  sf->fd = fd;
+  sf->left = length;
+  ud->client.sendfile = sf;
+  ud->client.sent_pending = 1;
+
+  // the file follows any data queued by send()
+  err_t err = net_tcp_pump(ud);
+  if (err != ERR_OK) {
+    net_sendfile_free(ud);
+    ud->client.sent_pending = 0;
   }
   return lwip_lua_checkerr(L, err);
 }
@@ -743,6 +1042,8 @@ int net_close( lua_State *L ) {
   if (ud->pcb) {
     switch (ud->type) {
       case TYPE_TCP_CLIENT:
+        net_sendq_free(&ud->client.sendq);
+        net_sendfile_free(ud);
         if (ERR_OK != tcp_close(ud->tcp_pcb)) {
           tcp_arg(ud->tcp_pcb, NULL);
           tcp_abort(ud->tcp_pcb);
@@ -793,12 +1094,17 @@ int net_delete( lua_State *L ) {
   }
   switch (ud->type) {
     case TYPE_TCP_CLIENT:
+      net_sendq_free(&ud->client.sendq);
+      net_sendfile_free(ud);
       luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_connect_ref);
       ud->client.cb_connect_ref = LUA_NOREF;
       luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_disconnect_ref);
       ud->client.cb_disconnect_ref = LUA_NOREF;
       luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_reconnect_ref);
       ud->client.cb_reconnect_ref = LUA_NOREF;
+      luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_data_ref);
+      ud->client.cb_data_ref = LUA_NOREF;
+      net_rxbuf_release(L, ud);
     case TYPE_UDP_SOCKET:
       luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_dns_ref);
       ud->client.cb_dns_ref = LUA_NOREF;
@@ -819,6 +1125,139 @@ int net_delete( lua_State *L ) {
   return 0;
 }
 
+#pragma mark - Receive buffer
+
+static lnet_rxbuf *net_rxbuf_check( lua_State *L ) {
+  return (lnet_rxbuf *)luaL_checkudata(L, 1, NET_TABLE_TCP_BUFFER);
+}
+
+static u16_t net_rxbuf_len( lnet_rxbuf *rb ) {
+  return rb->p ? rb->p->tot_len : 0;
+}
+
+// Drops the first n bytes and opens the TCP window by as much.
+static void net_rxbuf_consume( lnet_rxbuf *rb, u16_t n ) {
+  u16_t left = n;
+  while (rb->p && left >= rb->p->len) {
+    struct pbuf *q = rb->p->next;
+    left -= rb->p->len;
+    if (q) pbuf_ref(q);
+    pbuf_free(rb->p);
+    rb->p = q;
+  }
+  if (rb->p && left)
+    pbuf_header(rb->p, -(s16_t)left);
+  if (n && rb->ud && rb->ud->tcp_pcb)
+    tcp_recved(rb->ud->tcp_pcb, n);
+}
+
+// Pushes n bytes from offset as a string.
+static void net_rxbuf_push( lua_State *L, lnet_rxbuf *rb, u16_t offset, u16_t n ) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  while (n > 0) {
+    u16_t chunk = n < LUAL_BUFFERSIZE ? n : LUAL_BUFFERSIZE;
+    pbuf_copy_partial(rb->p, luaL_prepbuffer(&b), chunk, offset);
+    luaL_addsize(&b, chunk);
+    offset += chunk;
+    n -= chunk;
+  }
+  luaL_pushresult(&b);
+}
+
+// Negative positions count from the end, as with strings.
+static lua_Integer net_rxbuf_pos( lua_Integer pos, u16_t len ) {
+  return pos < 0 ? pos + len + 1 : pos;
+}
+
+// Lua: buf:len(), #buf
+static int net_rxbuf_llen( lua_State *L ) {
+  lua_pushinteger(L, net_rxbuf_len(net_rxbuf_check(L)));
+  return 1;
+}
+
+// Lua: buf:byte(i)
+static int net_rxbuf_byte( lua_State *L ) {
+  lnet_rxbuf *rb = net_rxbuf_check(L);
+  u16_t len = net_rxbuf_len(rb);
+  lua_Integer i = net_rxbuf_pos(luaL_checkinteger(L, 2), len);
+  if (i < 1 || i > len) return 0;
+  lua_pushinteger(L, pbuf_get_at(rb->p, i - 1));
+  return 1;
+}
+
+// Lua: buf:sub(i[, j])
+static int net_rxbuf_sub( lua_State *L ) {
+  lnet_rxbuf *rb = net_rxbuf_check(L);
+  u16_t len = net_rxbuf_len(rb);
+  lua_Integer i = net_rxbuf_pos(luaL_checkinteger(L, 2), len);
+  lua_Integer j = net_rxbuf_pos(luaL_optinteger(L, 3, -1), len);
+  if (i < 1) i = 1;
+  if (j > len) j = len;
+  net_rxbuf_push(L, rb, i - 1, j >= i ? j - i + 1 : 0);
+  return 1;
+}
+
+// Lua: start, end = buf:find(s[, init]), a plain search
+static int net_rxbuf_find( lua_State *L ) {
+  lnet_rxbuf *rb = net_rxbuf_check(L);
+  size_t sl;
+  const char *s = luaL_checklstring(L, 2, &sl);
+  u16_t len = net_rxbuf_len(rb);
+  lua_Integer init = net_rxbuf_pos(luaL_optinteger(L, 3, 1), len) - 1;
+  u16_t base = 0;
+  luaL_argcheck(L, sl > 0, 2, "empty string");
+  if (init < 0) init = 0;
+  for (struct pbuf *q = rb->p; q && base + sl <= len; base += q->len, q = q->next) {
+    if (base + q->len <= init) continue;
+    const char *d = (const char *)q->payload;
+    u16_t i = init > base ? init - base : 0;
+    const char *c;
+    while (i < q->len && (c = c_memchr(d + i, s[0], q->len - i))) {
+      i = c - d;
+      if (base + i + sl > len) return 0;
+      if (pbuf_memcmp(q, i, s, sl) == 0) {
+        lua_pushinteger(L, base + i + 1);
+        lua_pushinteger(L, base + i + sl);
+        return 2;
+      }
+      i++;
+    }
+  }
+  return 0;
+}
+
+// Lua: data = buf:read([n])
+static int net_rxbuf_read( lua_State *L ) {
+  lnet_rxbuf *rb = net_rxbuf_check(L);
+  u16_t len = net_rxbuf_len(rb);
+  lua_Integer n = luaL_optinteger(L, 2, len);
+  if (n > len) n = len;
+  if (n < 0) n = 0;
+  net_rxbuf_push(L, rb, 0, n);
+  net_rxbuf_consume(rb, n);
+  return 1;
+}
+
+// Lua: buf:skip(n)
+static int net_rxbuf_skip( lua_State *L ) {
+  lnet_rxbuf *rb = net_rxbuf_check(L);
+  u16_t len = net_rxbuf_len(rb);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  if (n > len) n = len;
+  if (n > 0) net_rxbuf_consume(rb, n);
+  return 0;
+}
+
+static int net_rxbuf_delete( lua_State *L ) {
+  lnet_rxbuf *rb = net_rxbuf_check(L);
+  if (rb->p) {
+    pbuf_free(rb->p);
+    rb->p = NULL;
+  }
+  return 0;
+}
+
 #pragma mark - Multicast
 
 static int net_multicastJoinLeave( lua_State *L, int join) {
@@ -986,6 +1425,7 @@ static const LUA_REG_TYPE net_tcpsocket_map[] = {
   { LSTRKEY( "close" ),   LFUNCVAL( net_close ) },
   { LSTRKEY( "on" ),      LFUNCVAL( net_on ) },
   { LSTRKEY( "send" ),    LFUNCVAL( net_send ) },
+  { LSTRKEY( "sendfile" ), LFUNCVAL( net_sendfile ) },
   { LSTRKEY( "hold" ),    LFUNCVAL( net_hold ) },
   { LSTRKEY( "unhold" ),  LFUNCVAL( net_unhold ) },
   { LSTRKEY( "dns" ),     LFUNCVAL( net_dns ) },
@@ -997,6 +1437,19 @@ static const LUA_REG_TYPE net_tcpsocket_map[] = {
   { LNILKEY, LNILVAL }
 };
 
+static const LUA_REG_TYPE net_tcpbuffer_map[] = {
+  { LSTRKEY( "len" ),     LFUNCVAL( net_rxbuf_llen ) },
+  { LSTRKEY( "byte" ),    LFUNCVAL( net_rxbuf_byte ) },
+  { LSTRKEY( "sub" ),     LFUNCVAL( net_rxbuf_sub ) },
+  { LSTRKEY( "find" ),    LFUNCVAL( net_rxbuf_find ) },
+  { LSTRKEY( "read" ),    LFUNCVAL( net_rxbuf_read ) },
+  { LSTRKEY( "skip" ),    LFUNCVAL( net_rxbuf_skip ) },
+  { LSTRKEY( "__len" ),   LFUNCVAL( net_rxbuf_llen ) },
+  { LSTRKEY( "__gc" ),    LFUNCVAL( net_rxbuf_delete ) },
+  { LSTRKEY( "__index" ), LROVAL( net_tcpbuffer_map ) },
+  { LNILKEY, LNILVAL }
+};
+
 static const LUA_REG_TYPE net_udpsocket_map[] = {
   { LSTRKEY( "listen" ),  LFUNCVAL( net_listen ) },
   { LSTRKEY( "close" ),   LFUNCVAL( net_close ) },
@@ -1039,6 +1492,7 @@ int luaopen_net( lua_State *L ) {
   luaL_rometatable(L, NET_TABLE_TCP_SERVER, (void *)net_tcpserver_map);
   luaL_rometatable(L, NET_TABLE_TCP_CLIENT, (void *)net_tcpsocket_map);
   luaL_rometatable(L, NET_TABLE_UDP_SOCKET, (void *)net_udpsocket_map);
+  luaL_rometatable(L, NET_TABLE_TCP_BUFFER, (void *)net_tcpbuffer_map);
 
   return 0;
 }
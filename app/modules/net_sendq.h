@@ -0,0 +1,26 @@
+#ifndef APP_MODULES_NET_SENDQ_H_
+#define APP_MODULES_NET_SENDQ_H_
+
+#include "lauxlib.h"
+
+#include "c_types.h"
+#include "lwip/err.h"
+#include "lwip/tcp.h"
+
+// Strings waiting to be handed to TCP, in a registry table from head to
+// tail-1. TCP copies the data into its segments, so a string is let go as
+// soon as it has been written. Shared by the net and httpd modules, the
+// functions are in net.c.
+typedef struct net_sendq {
+  int ref;        // LUA_NOREF while the queue is empty
+  int head;
+  int tail;
+  size_t off;     // bytes of the head string already written
+} net_sendq;
+
+void net_sendq_init( net_sendq *q );
+void net_sendq_free( net_sendq *q );
+void net_sendq_push( lua_State *L, net_sendq *q );
+err_t net_sendq_pump( net_sendq *q, struct tcp_pcb *pcb, int more );
+
+#endif /* APP_MODULES_NET_SENDQ_H_ */
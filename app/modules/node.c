@@ -10,6 +10,7 @@
 #include "lobject.h"
 #include "lstate.h"
 #include "legc.h"
+#include "lflash.h"
 
 #include "lopcodes.h"
 #include "lstring.h"
@@ -163,6 +164,87 @@ static int node_heap( lua_State* L )
   return 1;
 }
 
+#ifdef LUA_FLASH_STORE
+// Lua: node.flashindex([module])
+// Returns the function of module in the Lua flash store, or nil if there is
+// no such module; without an argument returns the list of module names.
+static int node_flashindex( lua_State* L )
+{
+  const char *name = luaL_optstring(L, 1, NULL);
+  int status;
+
+  if (name == NULL) {
+    luaN_pushindex(L);
+    return 1;
+  }
+  status = luaN_loadmodule(L, name);
+  if (status < 0)
+    lua_pushnil(L);
+  else if (status != 0)
+    return lua_error(L);
+  return 1;
+}
+#endif
+
+// Lua: node.gcstats([reset])
+// Returns a table of garbage collector counters accumulated since boot or
+// since the last reset; allocrate is in bytes per second. The counters are
+// pushed as numbers, they do not fit an integer past 2^31.
+// system_get_time() wraps after 71 minutes, so a timer gathers the time
+// since the last reset into 64 bits every half hour.
+#define GCSTATS_TICK_MS (30 * 60 * 1000)
+
+static uint64_t gcstats_us = 0;
+static uint32_t gcstats_last = 0;
+static os_timer_t gcstats_timer;
+
+static uint64_t gcstats_elapsed( void )
+{
+  uint32_t now = system_get_time();
+  gcstats_us += (uint32_t)(now - gcstats_last);
+  gcstats_last = now;
+  return gcstats_us;
+}
+
+static void gcstats_tick( void *arg )
+{
+  gcstats_elapsed();
+}
+
+static int node_gcstats( lua_State* L )
+{
+  global_State *g = G(L);
+  uint64_t elapsed = gcstats_elapsed();
+
+  lua_createtable(L, 0, 10);
+  lua_pushnumber(L, g->gccycles);
+  lua_setfield(L, -2, "cycles");
+  lua_pushnumber(L, g->gclastcycle);
+  lua_setfield(L, -2, "lastcycle");
+  lua_pushnumber(L, g->gcpausemax);
+  lua_setfield(L, -2, "pausemax");
+  lua_pushnumber(L, g->gcpausetotal);
+  lua_setfield(L, -2, "pausetotal");
+  lua_pushnumber(L, g->gcpausecount);
+  lua_setfield(L, -2, "pausecount");
+  lua_pushnumber(L, g->gcfreed);
+  lua_setfield(L, -2, "freed");
+  lua_pushnumber(L, g->gcallocated);
+  lua_setfield(L, -2, "allocated");
+  lua_pushnumber(L, elapsed ? (lua_Number)((uint64_t)g->gcallocated * 1000000 / elapsed) : 0);
+  lua_setfield(L, -2, "allocrate");
+  lua_pushnumber(L, g->egctriggers);
+  lua_setfield(L, -2, "egc");
+  lua_pushnumber(L, g->totalbytes);
+  lua_setfield(L, -2, "heap");
+  if (lua_toboolean(L, 1)) {
+    g->gccycles = g->gcfreed = g->gcallocated = g->egctriggers = 0;
+    g->gcpausemax = g->gcpausetotal = g->gcpausecount = 0;
+    gcstats_us = 0;
+  }
+  return 1;
+}
+
 extern lua_Load gLoad;
 extern bool user_process_input(bool force);
 // Lua: input("string")
@@ -470,6 +552,32 @@ static int node_egc_setmode(lua_State* L) {
   legc_set_mode( L, mode, limit );
   return 0;
 }
+
+// Lua: node.egc.setbudget(us)
+// Bounds each incremental collector step to about `us' microseconds; an
+// unfinished collection cycle is then completed from a low priority task.
+// A budget of 0 (the default) restores unbounded steps.
+static int node_egc_setbudget(lua_State* L) {
+  int budget = luaL_checkinteger(L, 1);
+
+  luaL_argcheck(L, budget >= 0, 1, "budget must not be negative");
+  legc_set_budget( L, budget );
+  return 0;
+}
+
+// Lua: max, total, count = node.egc.pausestats([reset])
+// Returns the longest and the total collector pause in microseconds and the
+// number of pauses; the counters are cleared if reset is true.
+static int node_egc_pausestats(lua_State* L) {
+  global_State *g = G(L);
+
+  lua_pushinteger(L, g->gcpausemax);
+  lua_pushinteger(L, g->gcpausetotal);
+  lua_pushinteger(L, g->gcpausecount);
+  if (lua_toboolean(L, 1))
+    g->gcpausemax = g->gcpausetotal = g->gcpausecount = 0;
+  return 3;
+}
 //
 // Lua: osprint(true/false)
 // Allows you to turn on the native Espressif SDK printing
@@ -561,6 +669,8 @@ static int node_random (lua_State *L) {
 
 static const LUA_REG_TYPE node_egc_map[] = {
   { LSTRKEY( "setmode" ),           LFUNCVAL( node_egc_setmode ) },
+  { LSTRKEY( "setbudget" ),         LFUNCVAL( node_egc_setbudget ) },
+  { LSTRKEY( "pausestats" ),        LFUNCVAL( node_egc_pausestats ) },
   { LSTRKEY( "NOT_ACTIVE" ),        LNUMVAL( EGC_NOT_ACTIVE ) },
   { LSTRKEY( "ON_ALLOC_FAILURE" ),  LNUMVAL( EGC_ON_ALLOC_FAILURE ) },
   { LSTRKEY( "ON_MEM_LIMIT" ),      LNUMVAL( EGC_ON_MEM_LIMIT ) },
@@ -588,6 +698,11 @@ static const LUA_REG_TYPE node_map[] =
   { LSTRKEY( "flashid" ), LFUNCVAL( node_flashid ) },
   { LSTRKEY( "flashsize" ), LFUNCVAL( node_flashsize) },
   { LSTRKEY( "heap" ), LFUNCVAL( node_heap ) },
+  { LSTRKEY( "gcstats" ), LFUNCVAL( node_gcstats ) },
+#ifdef LUA_FLASH_STORE
+  { LSTRKEY( "flashindex" ), LFUNCVAL( node_flashindex ) },
+  { LSTRKEY( "flashreload" ), LFUNCVAL( luaN_reload ) },
+#endif
   { LSTRKEY( "input" ), LFUNCVAL( node_input ) },
   { LSTRKEY( "output" ), LFUNCVAL( node_output ) },
 // Moved to adc module, use adc.readvdd33()
@@ -613,4 +728,13 @@ static const LUA_REG_TYPE node_map[] =
   { LNILKEY, LNILVAL }
 };
 
-NODEMCU_MODULE(NODE, "node", node_map, NULL);
+int luaopen_node( lua_State *L )
+{
+  gcstats_last = system_get_time();
+  os_timer_disarm(&gcstats_timer);
+  os_timer_setfn(&gcstats_timer, gcstats_tick, NULL);
+  os_timer_arm(&gcstats_timer, GCSTATS_TICK_MS, 1);
+  return 0;
+}
+
+NODEMCU_MODULE(NODE, "node", node_map, luaopen_node);
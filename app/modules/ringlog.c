@@ -0,0 +1,142 @@
+// Module for an append-only ring log of fixed size records in flash
+
+#include "module.h"
+#include "lauxlib.h"
+#include "user_config.h"
+#include "user_modules.h"
+
+#if defined(LUA_USE_MODULES_RINGLOG) && !defined(RINGLOG_SIZE)
+#error "The ringlog module needs RINGLOG_SIZE in user_config.h"
+#endif
+
+#ifdef RINGLOG_SIZE
+
+#include "ringlog.h"
+
+static uint32_t check_log (lua_State *L)
+{
+  uint32_t recsize = ringlog_open ();
+  if (!recsize)
+    luaL_error (L, "ring log not formatted");
+  return recsize;
+}
+
+
+// ringlog.format (recsize)
+static int ringlog_lformat (lua_State *L)
+{
+  uint32_t recsize = luaL_checkinteger (L, 1);
+  luaL_argcheck (L, recsize > 0 && recsize <= RINGLOG_MAX_RECORD, 1, "invalid record size");
+
+  if (ringlog_format (recsize) < 0)
+    return luaL_error (L, "formatting the ring log failed");
+  return 0;
+}
+
+
+// n = ringlog.append (data)
+static int ringlog_lappend (lua_State *L)
+{
+  uint32_t recsize = check_log (L);
+  size_t len;
+  const char *data = luaL_checklstring (L, 1, &len);
+  luaL_argcheck (L, len <= recsize, 1, "record too long");
+
+  sint32_t n = ringlog_append (data, len);
+  if (n < 0)
+    return luaL_error (L, "writing the ring log failed");
+  lua_pushinteger (L, n);
+  return 1;
+}
+
+
+// ringlog.flush ()
+static int ringlog_lflush (lua_State *L)
+{
+  check_log (L);
+
+  if (ringlog_flush () < 0)
+    return luaL_error (L, "writing the ring log failed");
+  return 0;
+}
+
+
+// data, n = ringlog.read (n)
+static int ringlog_lread (lua_State *L)
+{
+  uint32_t recsize = check_log (L);
+  uint32_t n = luaL_checkinteger (L, 1);
+  luaL_Buffer b;
+
+  luaL_buffinit (L, &b);
+  sint32_t found = ringlog_read (n, luaL_prepbuffer (&b));
+  if (found < 0)
+    return 0;
+  luaL_addsize (&b, recsize);
+  luaL_pushresult (&b);
+  lua_pushinteger (L, found);
+  return 2;
+}
+
+
+static int ringlog_records_iter (lua_State *L)
+{
+  uint32_t recsize = check_log (L);
+  uint32_t n = lua_tointeger (L, lua_upvalueindex (1));
+  luaL_Buffer b;
+
+  luaL_buffinit (L, &b);
+  sint32_t found = ringlog_read (n, luaL_prepbuffer (&b));
+  if (found < 0)
+    return 0;
+  luaL_addsize (&b, recsize);
+  luaL_pushresult (&b);
+  lua_pushinteger (L, found + 1);
+  lua_replace (L, lua_upvalueindex (1));
+  lua_pushinteger (L, found);
+  lua_insert (L, -2);
+  return 2;
+}
+
+// for n, data in ringlog.records ([from]) do ... end
+static int ringlog_lrecords (lua_State *L)
+{
+  uint32_t first, next;
+
+  check_log (L);
+  ringlog_info (&first, &next, NULL);
+  lua_pushinteger (L, luaL_optinteger (L, 1, first));
+  lua_pushcclosure (L, ringlog_records_iter, 1);
+  return 1;
+}
+
+
+// first, next, capacity, recsize = ringlog.info ()
+static int ringlog_linfo (lua_State *L)
+{
+  uint32_t recsize = check_log (L);
+  uint32_t first, next, capacity;
+
+  ringlog_info (&first, &next, &capacity);
+  lua_pushinteger (L, first);
+  lua_pushinteger (L, next);
+  lua_pushinteger (L, capacity);
+  lua_pushinteger (L, recsize);
+  return 4;
+}
+
+
+// Module function map
+static const LUA_REG_TYPE ringlog_map[] = {
+  { LSTRKEY("format"),  LFUNCVAL(ringlog_lformat) },
+  { LSTRKEY("append"),  LFUNCVAL(ringlog_lappend) },
+  { LSTRKEY("flush"),   LFUNCVAL(ringlog_lflush) },
+  { LSTRKEY("read"),    LFUNCVAL(ringlog_lread) },
+  { LSTRKEY("records"), LFUNCVAL(ringlog_lrecords) },
+  { LSTRKEY("info"),    LFUNCVAL(ringlog_linfo) },
+  { LNILKEY, LNILVAL }
+};
+
+NODEMCU_MODULE(RINGLOG, "ringlog", ringlog_map, NULL);
+
+#endif
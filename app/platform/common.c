@@ -67,7 +67,8 @@ uint32_t platform_flash_get_num_sectors(void)
 #endif // #ifdef INTERNAL_FLASH_SECTOR_SIZE
 }
 
-uint32_t platform_flash_get_first_free_block_address( uint32_t *psect )
+// Helper function: first flash block after the firmware image
+static uint32_t flashh_used_end_block( uint32_t *psect )
 {
   // Round the total used flash size to the closest flash block address
   uint32_t start, end, sect;
@@ -85,6 +86,45 @@ uint32_t platform_flash_get_first_free_block_address( uint32_t *psect )
   }
 }
 
+#ifdef LUA_FLASH_STORE
+// The Lua flash store occupies the LUA_FLASH_STORE bytes following the
+// firmware, so that it lies within the memory mapped part of the flash
+uint32_t platform_flash_get_lua_store_address( uint32_t *psect )
+{
+  return flashh_used_end_block( psect );
+}
+#endif
+
+// The ring log, if any, follows the Lua flash store
+static uint32_t flashh_ringlog_block( uint32_t *psect )
+{
+  uint32_t start = flashh_used_end_block( psect );
+#ifdef LUA_FLASH_STORE
+  start += LUA_FLASH_STORE;
+  if( psect )
+    *psect += LUA_FLASH_STORE / INTERNAL_FLASH_SECTOR_SIZE;
+#endif
+  return start;
+}
+
+#ifdef RINGLOG_SIZE
+uint32_t platform_flash_get_ringlog_address( uint32_t *psect )
+{
+  return flashh_ringlog_block( psect );
+}
+#endif
+
+uint32_t platform_flash_get_first_free_block_address( uint32_t *psect )
+{
+  uint32_t start = flashh_ringlog_block( psect );
+#ifdef RINGLOG_SIZE
+  start += RINGLOG_SIZE;
+  if( psect )
+    *psect += RINGLOG_SIZE / INTERNAL_FLASH_SECTOR_SIZE;
+#endif
+  return start;
+}
+
 uint32_t platform_flash_write( const void *from, uint32_t toaddr, uint32_t size )
 {
 #ifndef INTERNAL_FLASH_WRITE_UNIT_SIZE
@@ -931,6 +931,19 @@ uint32_t platform_flash_mapped2phys (uint32_t mapped_addr)
   return mapped_addr - INTERNAL_FLASH_MAPPED_ADDRESS + meg * 0x100000;
 }
 
+uint32_t platform_flash_phys2mapped (uint32_t phys_addr)
+{
+  uint32_t cache_ctrl = READ_PERI_REG(CACHE_FLASH_CTRL_REG);
+  if (!(cache_ctrl & CACHE_FLASH_ACTIVE))
+    return -1;
+  bool b0 = (cache_ctrl & CACHE_FLASH_MAPPED0) ? 1 : 0;
+  bool b1 = (cache_ctrl & CACHE_FLASH_MAPPED1) ? 1 : 0;
+  uint32_t meg = (b1 << 1) | b0;
+  if (phys_addr < meg * 0x100000 || phys_addr >= (meg + 1) * 0x100000)
+    return -1;
+  return phys_addr - meg * 0x100000 + INTERNAL_FLASH_MAPPED_ADDRESS;
+}
+
 void* platform_print_deprecation_note( const char *msg, const char *time_frame)
 {
   c_printf( "Warning, deprecated API! %s. It will be removed %s. See documentation for details.\n", msg, time_frame );
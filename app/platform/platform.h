@@ -269,6 +269,12 @@ uint32_t platform_eth_get_elapsed_time(void);
 // Internal flash erase/write functions
 
 uint32_t platform_flash_get_first_free_block_address( uint32_t *psect );
+#ifdef LUA_FLASH_STORE
+uint32_t platform_flash_get_lua_store_address( uint32_t *psect );
+#endif
+#ifdef RINGLOG_SIZE
+uint32_t platform_flash_get_ringlog_address( uint32_t *psect );
+#endif
 uint32_t platform_flash_get_sector_of_address( uint32_t addr );
 uint32_t platform_flash_write( const void *from, uint32_t toaddr, uint32_t size );
 uint32_t platform_flash_read( void *to, uint32_t fromaddr, uint32_t size );
@@ -287,6 +293,15 @@ int platform_flash_erase_sector( uint32_t sector_id );
  */
 uint32_t platform_flash_mapped2phys (uint32_t mapped_addr);
 
+/**
+ * Translates a physical flash address to the address it is mapped at,
+ * based on the current flash cache mapping.
+ * @param phys_addr Physical flash address to translate
+ * @return the corresponding mapped address, or -1 if flash cache is not
+ *  currently active or the address is outside the mapped megabyte.
+ */
+uint32_t platform_flash_phys2mapped (uint32_t phys_addr);
+
 // *****************************************************************************
 // Allocator support
 
@@ -0,0 +1,331 @@
+// Append-only ring log of fixed size records in flash
+
+#include "platform.h"
+#include "user_config.h"
+
+#ifdef RINGLOG_SIZE
+
+#include "c_string.h"
+#include "c_stdlib.h"
+#include "task/task.h"
+#include "ringlog.h"
+
+#if (RINGLOG_SIZE % INTERNAL_FLASH_SECTOR_SIZE) != 0 || \
+    RINGLOG_SIZE < 2 * INTERNAL_FLASH_SECTOR_SIZE
+#error "RINGLOG_SIZE must be a multiple of the flash sector size, and at least two sectors"
+#endif
+
+// Layout of a sector:
+//   ringlog_header
+//   slots, each holding the record padded to a multiple of 4 bytes and
+//   followed by a commit word
+//
+// The commit word holds a checksum of the record, so a record torn by a
+// reset is recognized and skipped. A sector is only written after it has
+// been erased, and its header goes first. Sector seq is at index
+// seq % nsect; the sector after the head is erased ahead of time by a task,
+// so that appending never waits for an erase unless the log fills faster
+// than the task gets to run.
+
+#define RINGLOG_MAGIC    0x474f4c52  // "RLOG"
+#define RINGLOG_COMMIT   0x5243      // low half of the commit word
+#define RINGLOG_BATCH    512
+#define RINGLOG_NSECT    (RINGLOG_SIZE / INTERNAL_FLASH_SECTOR_SIZE)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t recsize;
+  uint32_t check;
+} ringlog_header;
+
+static struct {
+  uint32_t base;        // flash address of the region
+  uint32_t sect0;       // its first sector
+  uint16_t recsize;
+  uint16_t slotsize;
+  uint16_t slots;       // slots per sector
+  uint16_t head_slot;   // next free slot of the head sector
+  uint32_t head_seq;
+  uint32_t tail_seq;    // oldest sector still holding records
+  uint32_t ready_seq;   // the sector for this seq is known to be erased
+  bool ready;
+  bool erase_posted;
+  uint16_t batch_len;
+  uint8_t *batch;       // records appended to the head sector, not yet written
+} rl;
+
+static task_handle_t erase_task_handle;
+
+#define slot_addr(seq, slot) \
+  (rl.base + ((seq) % RINGLOG_NSECT) * INTERNAL_FLASH_SECTOR_SIZE + \
+   sizeof(ringlog_header) + (slot) * rl.slotsize)
+
+static uint32_t header_check( const ringlog_header *h )
+{
+  return ~(h->magic ^ h->seq ^ h->recsize);
+}
+
+static uint16_t record_sum( const uint8_t *p, uint32_t len )
+{
+  // Fletcher-16
+  uint16_t a = 0, b = 0;
+  while (len--) {
+    a = (a + *p++) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+static bool read_header( uint32_t index, ringlog_header *h )
+{
+  platform_flash_read( h, rl.base + index * INTERNAL_FLASH_SECTOR_SIZE, sizeof(*h) );
+  return h->magic == RINGLOG_MAGIC && h->check == header_check( h ) &&
+         h->seq % RINGLOG_NSECT == index &&
+         h->recsize > 0 && h->recsize <= RINGLOG_MAX_RECORD;
+}
+
+static void set_recsize( uint32_t recsize )
+{
+  rl.recsize = recsize;
+  rl.slotsize = ((recsize + 3) & ~3) + 4;
+  rl.slots = (INTERNAL_FLASH_SECTOR_SIZE - sizeof(ringlog_header)) / rl.slotsize;
+}
+
+// Erase the sector for seq, dropping the records it held
+static int erase_sector( uint32_t seq )
+{
+  if (seq >= RINGLOG_NSECT && rl.tail_seq <= seq - RINGLOG_NSECT) {
+    rl.tail_seq = seq - RINGLOG_NSECT + 1;
+  }
+  rl.ready = false;
+  if (platform_flash_erase_sector( rl.sect0 + seq % RINGLOG_NSECT ) != PLATFORM_OK) {
+    return -1;
+  }
+  rl.ready = true;
+  rl.ready_seq = seq;
+  return 0;
+}
+
+static void erase_task( task_param_t param, uint8 prio )
+{
+  (void)param;
+  (void)prio;
+  rl.erase_posted = false;
+  if (rl.batch && !(rl.ready && rl.ready_seq == rl.head_seq + 1)) {
+    erase_sector( rl.head_seq + 1 );
+  }
+}
+
+static void post_erase( void )
+{
+  if (!erase_task_handle) {
+    erase_task_handle = task_get_id( erase_task );
+  }
+  if (!rl.erase_posted) {
+    rl.erase_posted = task_post_low( erase_task_handle, 0 );
+  }
+}
+
+static int start_sector( uint32_t seq )
+{
+  ringlog_header h;
+
+  if (!(rl.ready && rl.ready_seq == seq) && erase_sector( seq ) < 0) {
+    return -1;
+  }
+  rl.ready = false;
+  h.magic = RINGLOG_MAGIC;
+  h.seq = seq;
+  h.recsize = rl.recsize;
+  h.check = header_check( &h );
+  if (platform_flash_write( &h, rl.base + (seq % RINGLOG_NSECT) * INTERNAL_FLASH_SECTOR_SIZE,
+                            sizeof(h) ) != sizeof(h)) {
+    return -1;
+  }
+  rl.head_seq = seq;
+  rl.head_slot = 0;
+  post_erase();
+  return 0;
+}
+
+static bool slot_blank( uint32_t seq, uint32_t slot )
+{
+  uint32_t buf[(RINGLOG_MAX_RECORD + 4) / 4];
+  uint32_t i;
+
+  platform_flash_read( buf, slot_addr( seq, slot ), rl.slotsize );
+  for (i = 0; i < rl.slotsize / 4; i++) {
+    if (buf[i] != 0xffffffff) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t ringlog_open( void )
+{
+  ringlog_header h;
+  uint32_t i, head = 0;
+  bool found = false;
+
+  if (rl.batch) {
+    return rl.recsize;
+  }
+  rl.base = platform_flash_get_ringlog_address( &rl.sect0 );
+
+  // the head is the valid sector with the highest seq
+  for (i = 0; i < RINGLOG_NSECT; i++) {
+    if (read_header( i, &h ) && (!found || h.seq > rl.head_seq)) {
+      found = true;
+      head = i;
+      rl.head_seq = h.seq;
+      set_recsize( h.recsize );
+    }
+  }
+  if (!found) {
+    return 0;
+  }
+
+  // the tail is the end of the run of sectors with consecutive seqs
+  rl.tail_seq = rl.head_seq;
+  for (i = 1; i < RINGLOG_NSECT && rl.tail_seq > 0; i++) {
+    uint32_t index = (head + RINGLOG_NSECT - i) % RINGLOG_NSECT;
+    if (!read_header( index, &h ) || h.seq != rl.tail_seq - 1 || h.recsize != rl.recsize) {
+      break;
+    }
+    rl.tail_seq--;
+  }
+
+  // records are written in order, so the head ends after the last used slot
+  rl.head_slot = rl.slots;
+  while (rl.head_slot > 0 && slot_blank( rl.head_seq, rl.head_slot - 1 )) {
+    rl.head_slot--;
+  }
+
+  if (!(rl.batch = (uint8_t *)c_malloc( RINGLOG_BATCH ))) {
+    return 0;
+  }
+  rl.batch_len = 0;
+  rl.ready = false;
+  post_erase();
+  return rl.recsize;
+}
+
+int ringlog_format( uint32_t recsize )
+{
+  uint32_t i;
+
+  if (recsize == 0 || recsize > RINGLOG_MAX_RECORD) {
+    return -1;
+  }
+  if (!rl.batch && !(rl.batch = (uint8_t *)c_malloc( RINGLOG_BATCH ))) {
+    return -1;
+  }
+  rl.base = platform_flash_get_ringlog_address( &rl.sect0 );
+  for (i = 0; i < RINGLOG_NSECT; i++) {
+    if (platform_flash_erase_sector( rl.sect0 + i ) != PLATFORM_OK) {
+      c_free( rl.batch );
+      rl.batch = NULL;
+      return -1;
+    }
+  }
+  set_recsize( recsize );
+  rl.batch_len = 0;
+  rl.tail_seq = 0;
+  rl.ready = true;
+  rl.ready_seq = 0;
+  if (start_sector( 0 ) < 0) {
+    c_free( rl.batch );
+    rl.batch = NULL;
+    return -1;
+  }
+  // every other sector has just been erased as well
+  rl.ready = true;
+  rl.ready_seq = 1;
+  return 0;
+}
+
+int ringlog_flush( void )
+{
+  if (!rl.batch) {
+    return -1;
+  }
+  if (rl.batch_len == 0) {
+    return 0;
+  }
+  uint32_t len = rl.batch_len;
+  rl.batch_len = 0;
+  if (platform_flash_write( rl.batch, slot_addr( rl.head_seq, rl.head_slot ), len ) != len) {
+    return -1;
+  }
+  rl.head_slot += len / rl.slotsize;
+  return 0;
+}
+
+sint32_t ringlog_append( const void *data, uint32_t len )
+{
+  if (!rl.batch || len > rl.recsize) {
+    return -1;
+  }
+  uint32_t pending = rl.batch_len / rl.slotsize;
+  if (rl.head_slot + pending == rl.slots) {
+    if (ringlog_flush() < 0 || start_sector( rl.head_seq + 1 ) < 0) {
+      return -1;
+    }
+  } else if (rl.batch_len + rl.slotsize > RINGLOG_BATCH) {
+    if (ringlog_flush() < 0) {
+      return -1;
+    }
+  }
+
+  uint8_t *p = rl.batch + rl.batch_len;
+  uint32_t datalen = rl.slotsize - 4;
+  c_memcpy( p, data, len );
+  c_memset( p + len, 0, datalen - len );
+  uint32_t commit = ((uint32_t)record_sum( p, datalen ) << 16) | RINGLOG_COMMIT;
+  c_memcpy( p + datalen, &commit, 4 );
+  rl.batch_len += rl.slotsize;
+
+  return rl.head_seq * rl.slots + rl.head_slot + rl.batch_len / rl.slotsize - 1;
+}
+
+sint32_t ringlog_read( uint32_t n, void *buf )
+{
+  uint32_t first, next;
+  uint32_t slot[(RINGLOG_MAX_RECORD + 4) / 4];
+  uint32_t datalen = rl.slotsize - 4;
+
+  if (!rl.batch) {
+    return -1;
+  }
+  ringlog_info( &first, &next, NULL );
+  for (n = n < first ? first : n; n < next; n++) {
+    uint32_t seq = n / rl.slots, s = n % rl.slots;
+    if (seq == rl.head_seq && s >= rl.head_slot) {
+      // still in the batch
+      c_memcpy( buf, rl.batch + (s - rl.head_slot) * rl.slotsize, rl.recsize );
+      return n;
+    }
+    platform_flash_read( slot, slot_addr( seq, s ), rl.slotsize );
+    uint32_t commit = slot[datalen / 4];
+    if ((commit & 0xffff) == RINGLOG_COMMIT &&
+        (commit >> 16) == record_sum( (const uint8_t *)slot, datalen )) {
+      c_memcpy( buf, slot, rl.recsize );
+      return n;
+    }
+  }
+  return -1;
+}
+
+void ringlog_info( uint32_t *first, uint32_t *next, uint32_t *capacity )
+{
+  *first = rl.tail_seq * rl.slots;
+  *next = rl.head_seq * rl.slots + rl.head_slot + rl.batch_len / rl.slotsize;
+  if (capacity) {
+    // one sector is kept erased
+    *capacity = (RINGLOG_NSECT - 1) * rl.slots;
+  }
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __RINGLOG_H__
+#define __RINGLOG_H__
+
+#include "c_types.h"
+
+// Ring log: fixed size records appended to a dedicated region of flash (see
+// RINGLOG_SIZE in user_config.h). The region is a ring of sectors, each
+// starting with a header that holds its sequence number. Records are
+// numbered from the start of the log; once the ring is full the oldest
+// sector is erased and its records are dropped. Appended records are kept
+// in RAM and written in one go when a batch is full or the log is flushed.
+
+#define RINGLOG_MAX_RECORD  256
+
+// Mount the log, returning its record size, or 0 if the region does not
+// hold a log.
+uint32_t ringlog_open( void );
+// Erase the region and start an empty log of records of recsize bytes.
+int ringlog_format( uint32_t recsize );
+// Append a record of up to recsize bytes, padded with zeros. Returns the
+// number of the record, or -1 on error.
+sint32_t ringlog_append( const void *data, uint32_t len );
+// Write the records appended so far to flash.
+int ringlog_flush( void );
+// Read the first intact record numbered n or later into buf, which holds
+// recsize bytes. Returns its number, or -1 if there is none.
+sint32_t ringlog_read( uint32_t n, void *buf );
+// Report the number of the oldest record, the number the next record will
+// get, and the capacity of the log in records.
+void ringlog_info( uint32_t *first, uint32_t *next, uint32_t *capacity );
+
+#endif
@@ -260,6 +260,7 @@ static int sdcard_read_data( uint8_t *dst, size_t count )
   set_timeout( &to, 100 * 1000 );
   while ((m_status = platform_spi_send_recv( m_spi_no, 8, 0xff)) == 0xff) {
     if (timed_out( &to )) {
+      m_error = SD_CARD_ERROR_READ_TIMEOUT;
       goto fail;
     }
   }
@@ -454,6 +455,10 @@ int platform_sdcard_read_blocks( uint8_t ss_pin, uint32_t block, size_t num, uin
     m_error = SD_CARD_ERROR_CMD12;
     goto fail;
   }
+  if (num > 0) {
+    // a block failed, m_error tells why
+    goto fail;
+  }
   sdcard_chipselect_high();
   return TRUE;
 
@@ -556,6 +561,8 @@ int platform_sdcard_write_blocks( uint8_t ss_pin, uint32_t block, size_t num, co
   return sdcard_write_stop();
 
   fail_write:
+  // leave the card ready for the next command
+  sdcard_write_stop();
   m_error = SD_CARD_ERROR_WRITE_MULTIPLE;
   fail:
   sdcard_chipselect_high();
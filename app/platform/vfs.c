@@ -261,6 +261,25 @@ sint32_t vfs_fsinfo( const char *name, uint32_t *total, uint32_t *used )
   return VFS_RES_ERR;
 }
 
+sint32_t vfs_fsstat( struct vfs_fsstat *buf )
+{
+  vfs_fs_fns *fs_fns;
+  char *outname;
+
+#ifdef BUILD_SPIFFS
+  if (fs_fns = myspiffs_realm( "/FLASH", &outname, FALSE )) {
+    return fs_fns->fsstat( buf );
+  }
+#endif
+
+#ifdef BUILD_FATFS
+  // not supported
+#endif
+
+  // Error
+  return VFS_RES_ERR;
+}
+
 sint32_t vfs_fscfg( const char *name, uint32_t *phys_addr, uint32_t *phys_size)
 {
   vfs_fs_fns *fs_fns;
@@ -88,6 +88,15 @@ inline uint32_t vfs_size( int fd ) {
   return f ? f->fns->size( f ) : 0;
 }
 
+// vfs_expand - allocate contiguous space for an empty file
+//   fd: file descriptor
+//   size: number of bytes to allocate
+//   Returns: VFS_RES_OK, or VFS_RES_ERR in case of error
+inline sint32_t vfs_expand( int fd, uint32_t size ) {
+  vfs_file *f = (vfs_file *)fd;
+  return f && f->fns->expand ? f->fns->expand( f, size ) : VFS_RES_ERR;
+}
+
 // vfs_ferrno - get file system specific errno
 //   fd: file descriptor
 //   Returns: errno
@@ -181,6 +190,11 @@ sint32_t  vfs_chdir( const char *path );
 //   Returns: VFS_RES_OK, or VFS_RES_ERR in case of error
 sint32_t vfs_fscfg( const char *name, uint32_t *phys_addr, uint32_t *phys_size);
 
+// vfs_fsstat - get cache and flash access statistics of the internal file system
+//   buf: pointer to vfs_fsstat structure
+//   Returns: VFS_RES_OK, or VFS_RES_ERR in case of error
+sint32_t vfs_fsstat( struct vfs_fsstat *buf );
+
 // vfs_errno - get file system specific errno
 //   name: logical drive identifier
 //   Returns: errno
@@ -60,6 +60,15 @@ struct vfs_stat {
   uint8_t is_arch;
 };
 
+// file system statistics
+struct vfs_fsstat {
+  uint32_t cache_hits;
+  uint32_t cache_misses;
+  uint32_t flash_reads;
+  uint32_t flash_writes;
+  uint32_t flash_erases;
+};
+
 // file descriptor functions
 struct vfs_file_fns {
   sint32_t (*close)( const struct vfs_file *fd );
@@ -70,6 +79,7 @@ struct vfs_file_fns {
   sint32_t (*tell)( const struct vfs_file *fd );
   sint32_t (*flush)( const struct vfs_file *fd );
   uint32_t (*size)( const struct vfs_file *fd );
+  sint32_t (*expand)( const struct vfs_file *fd, uint32_t size );
   sint32_t (*ferrno)( const struct vfs_file *fd );
 };
 typedef const struct vfs_file_fns vfs_file_fns;
@@ -111,6 +121,7 @@ struct vfs_fs_fns {
   sint32_t  (*mkdir)( const char *name );
   sint32_t  (*fsinfo)( uint32_t *total, uint32_t *used );
   sint32_t  (*fscfg)( uint32_t *phys_addr, uint32_t *phys_size );
+  sint32_t  (*fsstat)( struct vfs_fsstat *buf );
   sint32_t  (*format)( void );
   sint32_t  (*chdrive)( const char * );
   sint32_t  (*chdir)( const char * );
@@ -18,3 +18,14 @@ int myspiffs_rename( const char *old, const char *newname );
 size_t myspiffs_size( int fd );
 int myspiffs_format (void);
 
+
+// Memory mapped read access to a file, without copying it into RAM. The file
+// stays open until the map is closed. Pointers from myspiffs_map_ptr() are
+// valid until the file system is next modified, and only allow aligned 32 bit
+// loads; myspiffs_map_read() copies bytes from any offset.
+typedef struct myspiffs_map myspiffs_map;
+myspiffs_map *myspiffs_map_open( const char *name );
+void myspiffs_map_close( myspiffs_map *m );
+uint32_t myspiffs_map_size( const myspiffs_map *m );
+const uint8_t *myspiffs_map_ptr( const myspiffs_map *m, uint32_t offset, uint32_t *len );
+uint32_t myspiffs_map_read( const myspiffs_map *m, uint32_t offset, void *buf, uint32_t len );
@@ -9,9 +9,14 @@
 typedef uint32_t intptr_t;
 #endif
 
-// Turn off stats
-#define SPIFFS_CACHE_STATS 	    0
+// Cache stats are reported by file.fsstat(); GC stats are off
+// (tools/spiffsimg/spiffsbench turns them on)
+#ifndef SPIFFS_CACHE_STATS
+#define SPIFFS_CACHE_STATS 	    1
+#endif
+#ifndef SPIFFS_GC_STATS
 #define SPIFFS_GC_STATS             0
+#endif
 
 // Needs to align stuff
 #define SPIFFS_ALIGNED_OBJECT_INDEX_TABLES	1
@@ -20,6 +25,9 @@ typedef uint32_t intptr_t;
 #define SPIFFS_USE_MAGIC            1
 #define SPIFFS_USE_MAGIC_LENGTH     1
 
+// Index maps let myspiffs_map_open() find a file's pages in mapped flash
+#define SPIFFS_IX_MAP               1
+
 // Reduce the chance of returning disk full
 #define SPIFFS_GC_MAX_RUNS          256
 
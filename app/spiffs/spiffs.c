@@ -1,8 +1,12 @@
 #include "c_stdio.h"
 #include "platform.h"
 #include "spiffs.h"
+#include "myspiffs.h"
 
 #include "spiffs_nucleus.h"
+#ifdef SPIFFS_IDLE_GC_BLOCKS
+#include "task/task.h"
+#endif
 
 spiffs fs;
 
@@ -14,20 +18,26 @@ spiffs fs;
 static u8_t spiffs_work_buf[LOG_PAGE_SIZE*2];
 static u8_t spiffs_fds[sizeof(spiffs_fd) * SPIFFS_MAX_OPEN_FILES];
 #if SPIFFS_CACHE
-static u8_t myspiffs_cache[20 + (LOG_PAGE_SIZE+20)*4];
+static u8_t myspiffs_cache[sizeof(spiffs_cache) + (sizeof(spiffs_cache_page)+LOG_PAGE_SIZE)*SPIFFS_CACHE_PAGES];
 #endif
 
+// flash accesses, for file.fsstat()
+static u32_t flash_reads, flash_writes, flash_erases;
+
 static s32_t my_spiffs_read(u32_t addr, u32_t size, u8_t *dst) {
+  flash_reads++;
   platform_flash_read(dst, addr, size);
   return SPIFFS_OK;
 }
 
 static s32_t my_spiffs_write(u32_t addr, u32_t size, u8_t *src) {
+  flash_writes++;
   platform_flash_write(src, addr, size);
   return SPIFFS_OK;
 }
 
 static s32_t my_spiffs_erase(u32_t addr, u32_t size) {
+  flash_erases++;
   u32_t sect_first = platform_flash_get_sector_of_address(addr);
   u32_t sect_last = sect_first;
   while( sect_first <= sect_last )
@@ -214,6 +224,35 @@ int myspiffs_format( void )
   return myspiffs_mount();
 }
 
+#ifdef SPIFFS_IDLE_GC_BLOCKS
+// Background garbage collection: while fewer than SPIFFS_IDLE_GC_BLOCKS
+// blocks are free, reclaim one block per low priority task, so that the
+// erases happen between Lua callbacks rather than in the middle of a write.
+static task_handle_t gc_task = 0;
+static bool gc_posted = FALSE;
+
+static void myspiffs_gc_task(task_param_t param, uint8 prio) {
+  (void)param;
+  (void)prio;
+  gc_posted = FALSE;
+  if (SPIFFS_mounted(&fs) && SPIFFS_gc_idle(&fs, SPIFFS_IDLE_GC_BLOCKS) == 1) {
+    gc_posted = task_post_low(gc_task, 0);
+  }
+}
+
+static void myspiffs_gc_kick(void) {
+  if (gc_posted || fs.free_blocks >= SPIFFS_IDLE_GC_BLOCKS) {
+    return;
+  }
+  if (!gc_task) {
+    gc_task = task_get_id(myspiffs_gc_task);
+  }
+  gc_posted = task_post_low(gc_task, 0);
+}
+#else
+#define myspiffs_gc_kick()
+#endif
+
 #if 0
 void test_spiffs() {
   char buf[12];
@@ -267,6 +306,7 @@ static sint32_t  myspiffs_vfs_remove( const char *name );
 static sint32_t  myspiffs_vfs_rename( const char *oldname, const char *newname );
 static sint32_t  myspiffs_vfs_fsinfo( uint32_t *total, uint32_t *used );
 static sint32_t  myspiffs_vfs_fscfg( uint32_t *phys_addr, uint32_t *phys_size );
+static sint32_t  myspiffs_vfs_fsstat( struct vfs_fsstat *buf );
 static sint32_t  myspiffs_vfs_format( void );
 static sint32_t  myspiffs_vfs_errno( void );
 static void      myspiffs_vfs_clearerr( void );
@@ -286,6 +326,7 @@ static vfs_fs_fns myspiffs_fs_fns = {
   .mkdir    = NULL,
   .fsinfo   = myspiffs_vfs_fsinfo,
   .fscfg    = myspiffs_vfs_fscfg,
+  .fsstat   = myspiffs_vfs_fsstat,
   .format   = myspiffs_vfs_format,
   .chdrive  = NULL,
   .chdir    = NULL,
@@ -302,6 +343,7 @@ static vfs_file_fns myspiffs_file_fns = {
   .tell      = myspiffs_vfs_tell,
   .flush     = myspiffs_vfs_flush,
   .size      = myspiffs_vfs_size,
+  .expand    = NULL,
   .ferrno    = myspiffs_vfs_ferrno
 };
 
@@ -385,6 +427,8 @@ static sint32_t myspiffs_vfs_close( const struct vfs_file *fd ) {
   // free descriptor memory
   c_free( (void *)fd );
 
+  myspiffs_gc_kick();
+
   return res;
 }
 
@@ -401,6 +445,8 @@ static sint32_t myspiffs_vfs_write( const struct vfs_file *fd, const void *ptr,
 
   sint32_t n = SPIFFS_write( &fs, fh, (void *)ptr, len );
 
+  myspiffs_gc_kick();
+
   return n >= 0 ? n : VFS_RES_ERR;
 }
 
@@ -536,7 +582,11 @@ static sint32_t myspiffs_vfs_stat( const char *name, struct vfs_stat *buf ) {
 }
 
 static sint32_t myspiffs_vfs_remove( const char *name ) {
-  return SPIFFS_remove( &fs, name );
+  sint32_t res = SPIFFS_remove( &fs, name );
+
+  myspiffs_gc_kick();
+
+  return res;
 }
 
 static sint32_t myspiffs_vfs_rename( const char *oldname, const char *newname ) {
@@ -553,6 +603,19 @@ static sint32_t myspiffs_vfs_fscfg( uint32_t *phys_addr, uint32_t *phys_size ) {
   return VFS_RES_OK;
 }
 
+static sint32_t myspiffs_vfs_fsstat( struct vfs_fsstat *buf ) {
+#if SPIFFS_CACHE && SPIFFS_CACHE_STATS
+  buf->cache_hits = fs.cache_hits;
+  buf->cache_misses = fs.cache_misses;
+#else
+  buf->cache_hits = buf->cache_misses = 0;
+#endif
+  buf->flash_reads = flash_reads;
+  buf->flash_writes = flash_writes;
+  buf->flash_erases = flash_erases;
+  return VFS_RES_OK;
+}
+
 static vfs_vol  *myspiffs_vfs_mount( const char *name, int num ) {
   // volume descriptor not supported, just return TRUE / FALSE
   return myspiffs_mount() ? (vfs_vol *)1 : NULL;
@@ -599,3 +662,101 @@ vfs_fs_fns *myspiffs_realm( const char *inname, char **outname, int set_current_
   if (set_current_drive) is_current_drive = FALSE;
   return NULL;
 }
+
+
+// ***************************************************************************
+// memory mapped read access
+// ***************************************************************************
+
+// A mapped file is kept open with a SPIFFS index map, which lists the page of
+// each span of the file and is updated by SPIFFS when garbage collection
+// moves those pages. Every page starts with a header, so the file is not
+// contiguous in flash; it is accessed one page of data at a time.
+struct myspiffs_map {
+  spiffs_file fh;
+  uint32_t size;
+  spiffs_ix_map ix;
+  spiffs_page_ix pix[];
+};
+
+myspiffs_map *myspiffs_map_open( const char *name ) {
+  char *outname;
+  spiffs_stat stat;
+  myspiffs_map *m;
+
+  if (!myspiffs_realm( name, &outname, FALSE ) ||
+      platform_flash_phys2mapped( fs.cfg.phys_addr + fs.cfg.phys_size - 1 ) == (uint32_t)-1) {
+    // not on SPIFFS, or the file system is not within the mapped flash
+    return NULL;
+  }
+  spiffs_file fh = SPIFFS_open( &fs, outname, SPIFFS_RDONLY, 0 );
+  if (fh < 0) {
+    return NULL;
+  }
+  if (SPIFFS_fstat( &fs, fh, &stat ) < 0 ||
+      !(m = (myspiffs_map *)c_malloc( sizeof( myspiffs_map ) +
+              SPIFFS_bytes_to_ix_map_entries( &fs, stat.size ) * sizeof( spiffs_page_ix ) ))) {
+    SPIFFS_close( &fs, fh );
+    return NULL;
+  }
+  m->fh = fh;
+  m->size = stat.size;
+  if (stat.size > 0 && SPIFFS_ix_map( &fs, fh, &m->ix, 0, stat.size, m->pix ) < 0) {
+    SPIFFS_close( &fs, fh );
+    c_free( m );
+    return NULL;
+  }
+  return m;
+}
+
+void myspiffs_map_close( myspiffs_map *m ) {
+  SPIFFS_close( &fs, m->fh );
+  c_free( m );
+}
+
+uint32_t myspiffs_map_size( const myspiffs_map *m ) {
+  return m->size;
+}
+
+const uint8_t *myspiffs_map_ptr( const myspiffs_map *m, uint32_t offset, uint32_t *len ) {
+  if (offset >= m->size) {
+    *len = 0;
+    return NULL;
+  }
+  uint32_t in_page = offset % SPIFFS_DATA_PAGE_SIZE( &fs );
+  uint32_t addr = SPIFFS_PAGE_TO_PADDR( &fs, m->pix[offset / SPIFFS_DATA_PAGE_SIZE( &fs )] ) +
+                  sizeof( spiffs_page_header ) + in_page;
+  *len = SPIFFS_DATA_PAGE_SIZE( &fs ) - in_page;
+  if (*len > m->size - offset) {
+    *len = m->size - offset;
+  }
+  return (const uint8_t *)platform_flash_phys2mapped( addr );
+}
+
+uint32_t myspiffs_map_read( const myspiffs_map *m, uint32_t offset, void *buf, uint32_t len ) {
+  uint8_t *dst = (uint8_t *)buf;
+  uint32_t done = 0;
+  while (done < len) {
+    uint32_t avail;
+    const uint8_t *src = myspiffs_map_ptr( m, offset + done, &avail );
+    if (!src) {
+      break;
+    }
+    if (avail > len - done) {
+      avail = len - done;
+    }
+    // mapped flash only allows aligned 32 bit loads
+    const uint32_t *word = (const uint32_t *)((uint32_t)src & ~3);
+    uint32_t shift = (uint32_t)src & 3, i;
+    uint32_t w = *word++;
+    for (i = 0; i < avail; i++) {
+      if (shift == 4) {
+        w = *word++;
+        shift = 0;
+      }
+      dst[done + i] = (uint8_t)(w >> (8 * shift++));
+    }
+    done += avail;
+  }
+  return done;
+}
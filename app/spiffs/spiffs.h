@@ -674,6 +674,21 @@ s32_t SPIFFS_gc_quick(spiffs *fs, u16_t max_free_pages);
  */
 s32_t SPIFFS_gc(spiffs *fs, u32_t size);
 
+/**
+ * Reclaims at most one block, if fewer than min_free_blocks blocks are
+ * free. Meant to be called repeatedly while the system is idle, so that
+ * writes find free blocks and rarely need to wait for the garbage
+ * collector. A block with only deleted pages is erased if there is one;
+ * otherwise the block the garbage collector would pick is cleaned.
+ *
+ * Returns 1 if a block was reclaimed and more free blocks are wanted, 0
+ * if there is nothing (more) worth reclaiming, or an error code.
+ *
+ * @param fs              the file system struct
+ * @param min_free_blocks number of free blocks to keep
+ */
+s32_t SPIFFS_gc_idle(spiffs *fs, u32_t min_free_blocks);
+
 /**
  * Check if EOF reached.
  * @param fs            the file system struct
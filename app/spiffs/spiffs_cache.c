@@ -117,6 +117,75 @@ void spiffs_cache_drop_page(spiffs *fs, spiffs_page_ix pix) {
   }
 }
 
+#if SPIFFS_CACHE_READ_AHEAD
+// reads up to n pages from pix onwards into consecutive cache pages with one
+// flash read, and returns the cache page for pix, or null if fewer than two
+// pages can be read. The cache pages reused are the least recently used run
+// that holds no write cache.
+static spiffs_cache_page *spiffs_cache_read_ahead(spiffs *fs, spiffs_page_ix pix, int n, s32_t *res) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  int i, k, start = -1;
+  u32_t best_age = 0;
+
+  // stay within the block, and stop at pages that are cached already
+  n = MIN(n, (int)(SPIFFS_PAGES_PER_BLOCK(fs) - pix % SPIFFS_PAGES_PER_BLOCK(fs)));
+  for (i = 0; i < cache->cpage_count; i++) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
+    if ((cache->cpage_use_map & (1<<i)) &&
+        (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
+        cp->pix > pix && cp->pix < pix + n) {
+      n = cp->pix - pix;
+    }
+  }
+
+  while (n >= 2) {
+    for (i = 0; i + n <= cache->cpage_count; i++) {
+      // the age of a run is the age of its most recently used page
+      u32_t age = 0xffffffff;
+      for (k = i; k < i + n; k++) {
+        spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, k);
+        if ((cache->cpage_use_map & (1<<k)) == 0) continue;
+        if (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) break;
+        age = MIN(age, cache->last_access - cp->last_access);
+      }
+      if (k == i + n && age > best_age) {
+        best_age = age;
+        start = i;
+      }
+    }
+    if (start >= 0) break;
+    n--;
+  }
+  if (start < 0) {
+    return 0;
+  }
+
+  for (k = start; k < start + n; k++) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, k);
+    s32_t res2 = spiffs_cache_page_free(fs, k, 1);
+    if (res2 != SPIFFS_OK) {
+      *res = res2;
+    }
+    cache->cpage_use_map |= (1<<k);
+    cp->flags = SPIFFS_CACHE_FLAG_WRTHRU;
+    cp->pix = pix + (k - start);
+    cp->last_access = cache->last_access;
+  }
+  SPIFFS_CACHE_DBG("CACHE_RA: read "_SPIPRIi" pages from pix "_SPIPRIpg" to cache page "_SPIPRIi"\n", n, pix, start);
+  s32_t res2 = SPIFFS_HAL_READ(fs, SPIFFS_PAGE_TO_PADDR(fs, pix),
+      n * SPIFFS_CFG_LOG_PAGE_SZ(fs), spiffs_get_cache_page(fs, cache, start));
+  if (res2 != SPIFFS_OK) {
+    // drop what could not be read
+    for (k = start; k < start + n; k++) {
+      spiffs_cache_page_free(fs, k, 0);
+    }
+    *res = res2;
+    return 0;
+  }
+  return spiffs_get_cache_page_hdr(fs, cache, start);
+}
+#endif
+
 // ------------------------------
 
 // reads from spi flash or the cache
@@ -132,6 +201,19 @@ s32_t spiffs_phys_rd(
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp =  spiffs_cache_page_get(fs, SPIFFS_PADDR_TO_PAGE(fs, addr));
   cache->last_access++;
+#if SPIFFS_CACHE_READ_AHEAD
+  // a data page read right after the page before it is sequential, a second
+  // read from the same page does not change the pattern
+  u8_t sequential = 0;
+  if ((op & SPIFFS_OP_TYPE_MASK) == SPIFFS_OP_T_OBJ_DA &&
+      SPIFFS_PADDR_TO_PAGE(fs, addr) != (spiffs_page_ix)(cache->ra_pix - 1)) {
+    sequential = SPIFFS_PADDR_TO_PAGE(fs, addr) == cache->ra_pix;
+    cache->ra_pix = SPIFFS_PADDR_TO_PAGE(fs, addr) + 1;
+    if (!sequential) {
+      cache->ra_pages = 1;
+    }
+  }
+#endif
   if (cp) {
     // we've already got one, you see
 #if SPIFFS_CACHE_STATS
@@ -150,6 +232,17 @@ s32_t spiffs_phys_rd(
 #endif
     // this operation will always free one cache page (unless all already free),
     // the result code stems from the write operation of the possibly freed cache page
+#if SPIFFS_CACHE_READ_AHEAD
+    if (sequential && cache->ra_max >= 2) {
+      cache->ra_pages = MIN(cache->ra_pages * 2, cache->ra_max);
+      cp = spiffs_cache_read_ahead(fs, SPIFFS_PADDR_TO_PAGE(fs, addr), cache->ra_pages, &res);
+      if (cp) {
+        u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
+        _SPIFFS_MEMCPY(dst, &mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], len);
+        return res;
+      }
+    }
+#endif
     res = spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
 
     cp = spiffs_cache_page_allocate(fs);
@@ -314,6 +407,11 @@ void spiffs_cache_init(spiffs *fs) {
   for (i = 0; i < cache.cpage_count; i++) {
     spiffs_get_cache_page_hdr(fs, c, i)->ix = i;
   }
+#if SPIFFS_CACHE_READ_AHEAD
+  // leave room for lookups and object index pages
+  c->ra_max = MIN(SPIFFS_CACHE_READ_AHEAD, c->cpage_count - 1);
+  c->ra_pages = 1;
+#endif
 }
 
 #endif // SPIFFS_CACHE
@@ -95,6 +95,13 @@
 #ifndef  SPIFFS_CACHE_STATS
 #define SPIFFS_CACHE_STATS              1
 #endif
+
+// Enable read-ahead: when a file's data pages are read in sequence, a miss
+// fills up to this many cache pages with one flash read. The number of
+// pages read doubles on each sequential miss. 0 disables read-ahead.
+#ifndef  SPIFFS_CACHE_READ_AHEAD
+#define SPIFFS_CACHE_READ_AHEAD         0
+#endif
 #else
 // No SPIFFS_CACHE, also disable SPIFFS_CACHE_WR
 #ifndef SPIFFS_CACHE_WR
@@ -3,6 +3,44 @@
 
 #if !SPIFFS_READ_ONLY
 
+// Counts the allocated and deleted pages of a block
+static s32_t spiffs_gc_count_pages(
+    spiffs *fs,
+    spiffs_block_ix bix,
+    u32_t *allocated,
+    u32_t *deleted) {
+  s32_t res = SPIFFS_OK;
+  int obj_lookup_page = 0;
+  int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
+  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  int cur_entry = 0;
+  u32_t dele = 0;
+  u32_t allo = 0;
+
+  // check each object lookup page
+  while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
+    int entry_offset = obj_lookup_page * entries_per_page;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
+        0, bix * SPIFFS_CFG_LOG_BLOCK_SZ(fs) + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+    // check each entry
+    while (res == SPIFFS_OK &&
+        cur_entry - entry_offset < entries_per_page && cur_entry < (int)(SPIFFS_PAGES_PER_BLOCK(fs)-SPIFFS_OBJ_LOOKUP_PAGES(fs))) {
+      spiffs_obj_id obj_id = obj_lu_buf[cur_entry-entry_offset];
+      if (obj_id == SPIFFS_OBJ_ID_FREE) {
+      } else if (obj_id == SPIFFS_OBJ_ID_DELETED) {
+        dele++;
+      } else {
+        allo++;
+      }
+      cur_entry++;
+    } // per entry
+    obj_lookup_page++;
+  } // per object lookup page
+  *allocated = allo;
+  *deleted = dele;
+  return res;
+}
+
 // Erases a logical block and updates the erase counter.
 // If cache is enabled, all pages that might be cached in this block
 // is dropped.
@@ -195,37 +233,83 @@ s32_t spiffs_gc_check(
   return res;
 }
 
+// Reclaims at most one block, if fewer than min_free_blocks blocks are free.
+// A block holding only deleted pages is erased if there is one, otherwise
+// the best candidate is cleaned as in spiffs_gc_check, passing over blocks that
+// hold more live than deleted pages. Returns 1 if a block was reclaimed and
+// more are wanted, 0 if there is nothing (more) to do.
+s32_t spiffs_gc_idle(
+    spiffs *fs,
+    u32_t min_free_blocks) {
+  s32_t res;
+  s32_t free_pages, prev_free_pages;
+  spiffs_block_ix *cands;
+  spiffs_block_ix cand;
+  int count;
+  int i;
+
+  if (fs->free_blocks >= min_free_blocks || fs->stats_p_deleted == 0) {
+    return 0;
+  }
+
+  res = spiffs_gc_quick(fs, 0);
+  if (res == SPIFFS_OK) {
+    return fs->free_blocks < min_free_blocks ? 1 : 0;
+  }
+  if (res != SPIFFS_ERR_NO_DELETED_BLOCKS) {
+    return res;
+  }
+
+  prev_free_pages =
+      (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2)
+      - fs->stats_p_allocated - fs->stats_p_deleted;
+  res = spiffs_gc_find_candidate(fs, &cands, &count, 0);
+  SPIFFS_CHECK_RES(res);
+  // only clean a block if at least half of its used pages are deleted, moving
+  // a mostly live block costs more writes than it frees; counting the pages
+  // reads into fs->lu_work, so cands in fs->work stays intact
+  count = MIN(count, (int)((SPIFFS_CFG_LOG_PAGE_SZ(fs)-8)/(sizeof(spiffs_block_ix) + sizeof(s32_t))));
+  for (i = 0; i < count; i++) {
+    u32_t allo, dele;
+    res = spiffs_gc_count_pages(fs, cands[i], &allo, &dele);
+    SPIFFS_CHECK_RES(res);
+    if (dele >= allo) {
+      break;
+    }
+  }
+  if (i == count) {
+    return 0;
+  }
+  // cleaning the block overwrites fs->work, and with it cands
+  cand = cands[i];
+#if SPIFFS_GC_STATS
+  fs->stats_gc_runs++;
+#endif
+  SPIFFS_GC_DBG("gc_idle: cleaning block "_SPIPRIbl"\n", cand);
+  fs->cleaning = 1;
+  res = spiffs_gc_clean(fs, cand);
+  fs->cleaning = 0;
+  SPIFFS_CHECK_RES(res);
+  res = spiffs_gc_erase_page_stats(fs, cand);
+  SPIFFS_CHECK_RES(res);
+  res = spiffs_gc_erase_block(fs, cand);
+  SPIFFS_CHECK_RES(res);
+
+  // stop when cleaning no longer frees any pages
+  free_pages =
+      (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2)
+      - fs->stats_p_allocated - fs->stats_p_deleted;
+  return free_pages > prev_free_pages && fs->free_blocks < min_free_blocks ? 1 : 0;
+}
+
 // Updates page statistics for a block that is about to be erased
 s32_t spiffs_gc_erase_page_stats(
     spiffs *fs,
     spiffs_block_ix bix) {
-  s32_t res = SPIFFS_OK;
-  int obj_lookup_page = 0;
-  int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
-  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
-  int cur_entry = 0;
-  u32_t dele = 0;
-  u32_t allo = 0;
-
-  // check each object lookup page
-  while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
-    int entry_offset = obj_lookup_page * entries_per_page;
-    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-        0, bix * SPIFFS_CFG_LOG_BLOCK_SZ(fs) + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
-    // check each entry
-    while (res == SPIFFS_OK &&
-        cur_entry - entry_offset < entries_per_page && cur_entry < (int)(SPIFFS_PAGES_PER_BLOCK(fs)-SPIFFS_OBJ_LOOKUP_PAGES(fs))) {
-      spiffs_obj_id obj_id = obj_lu_buf[cur_entry-entry_offset];
-      if (obj_id == SPIFFS_OBJ_ID_FREE) {
-      } else if (obj_id == SPIFFS_OBJ_ID_DELETED) {
-        dele++;
-      } else {
-        allo++;
-      }
-      cur_entry++;
-    } // per entry
-    obj_lookup_page++;
-  } // per object lookup page
+  u32_t dele;
+  u32_t allo;
+  s32_t res = spiffs_gc_count_pages(fs, bix, &allo, &dele);
+  SPIFFS_CHECK_RES(res);
   SPIFFS_GC_DBG("gc_check: wipe pallo:"_SPIPRIi" pdele:"_SPIPRIi"\n", allo, dele);
   fs->stats_p_allocated -= allo;
   fs->stats_p_deleted -= dele;
@@ -1184,6 +1184,25 @@ s32_t SPIFFS_gc(spiffs *fs, u32_t size) {
 #endif // SPIFFS_READ_ONLY
 }
 
+s32_t SPIFFS_gc_idle(spiffs *fs, u32_t min_free_blocks) {
+  SPIFFS_API_DBG("%s "_SPIPRIi "\n", __func__, min_free_blocks);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)min_free_blocks;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_gc_idle(fs, min_free_blocks);
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
+
 s32_t SPIFFS_eof(spiffs *fs, spiffs_file fh) {
   SPIFFS_API_DBG("%s "_SPIPRIfd "\n", __func__, fh);
   s32_t res;
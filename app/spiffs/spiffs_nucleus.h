@@ -391,11 +391,14 @@
 #define spiffs_get_cache(fs) \
   ((spiffs_cache *)((fs)->cache))
 
+// the cache page headers come first, followed by the page contents, so that
+// consecutive cache pages can be filled with one read
 #define spiffs_get_cache_page_hdr(fs, c, ix) \
-  ((spiffs_cache_page *)(&((c)->cpages[(ix) * SPIFFS_CACHE_PAGE_SIZE(fs)])))
+  (&((spiffs_cache_page *)(c)->cpages)[(ix)])
 
 #define spiffs_get_cache_page(fs, c, ix) \
-  ((u8_t *)(&((c)->cpages[(ix) * SPIFFS_CACHE_PAGE_SIZE(fs)])) + sizeof(spiffs_cache_page))
+  (&(c)->cpages[(c)->cpage_count * sizeof(spiffs_cache_page) + \
+                (ix) * SPIFFS_CFG_LOG_PAGE_SZ(fs)])
 
 // cache page struct
 typedef struct {
@@ -431,6 +434,14 @@ typedef struct {
   u32_t last_access;
   u32_t cpage_use_map;
   u32_t cpage_use_mask;
+#if SPIFFS_CACHE_READ_AHEAD
+  // page expected next when reading sequentially
+  spiffs_page_ix ra_pix;
+  // pages read ahead on the last sequential miss
+  u8_t ra_pages;
+  // maximum number of pages to read ahead
+  u8_t ra_max;
+#endif
   u8_t *cpages;
 } spiffs_cache;
 
@@ -763,6 +774,9 @@ s32_t spiffs_gc_clean(
 s32_t spiffs_gc_quick(
     spiffs *fs, u16_t max_free_pages);
 
+s32_t spiffs_gc_idle(
+    spiffs *fs, u32_t min_free_blocks);
+
 // ---------------
 
 s32_t spiffs_fd_find_new(
@@ -0,0 +1,15 @@
+-- Callback-style code: closure creation and upvalue access
+return {
+  ops = 200000,
+  run = function(n)
+    local total = 0
+    local function make(k)
+      return function(v) total = total + v * k; return total end
+    end
+    for i = 1, n do
+      local f = make(i % 7)
+      f(1)
+    end
+    return total
+  end
+}
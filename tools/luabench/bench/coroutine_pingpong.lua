@@ -0,0 +1,15 @@
+-- Resume/yield round trips between two coroutines
+return {
+  ops = 100000,
+  run = function(n)
+    local co = coroutine.create(function(v)
+      while true do v = coroutine.yield(v + 1) end
+    end)
+    local v = 0
+    for i = 1, n do
+      local _, r = coroutine.resume(co, v)
+      v = r
+    end
+    return v
+  end
+}
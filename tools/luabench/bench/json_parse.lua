@@ -0,0 +1,66 @@
+-- sjson-style decoding of small telemetry documents in plain Lua
+local doc = '{"id":1234,"name":"node-7","temp":21.5,"ok":true,' ..
+            '"tags":["a","bc","def"],"pos":{"x":1,"y":-2,"z":3.25},"note":null}'
+
+local byte, sub, find = string.byte, string.sub, string.find
+
+local decode
+
+local function skip(s, i)
+  return find(s, "[^ \t\r\n]", i) or #s + 1
+end
+
+local function value(s, i)
+  i = skip(s, i)
+  local c = byte(s, i)
+  if c == 123 then -- {
+    local t = {}
+    i = skip(s, i + 1)
+    if byte(s, i) == 125 then return t, i + 1 end
+    while true do
+      local k
+      k, i = value(s, i)
+      i = skip(s, i) + 1 -- :
+      t[k], i = value(s, i)
+      i = skip(s, i)
+      c = byte(s, i)
+      i = i + 1
+      if c == 125 then return t, i end
+    end
+  elseif c == 91 then -- [
+    local t, n = {}, 0
+    i = skip(s, i + 1)
+    if byte(s, i) == 93 then return t, i + 1 end
+    while true do
+      n = n + 1
+      t[n], i = value(s, i)
+      i = skip(s, i)
+      c = byte(s, i)
+      i = i + 1
+      if c == 93 then return t, i end
+    end
+  elseif c == 34 then -- "
+    local e = find(s, '"', i + 1, true)
+    return sub(s, i + 1, e - 1), e + 1
+  elseif c == 116 then return true, i + 4
+  elseif c == 102 then return false, i + 5
+  elseif c == 110 then return nil, i + 4
+  else
+    local e = find(s, "[^%d%.eE+-]", i) or #s + 1
+    return tonumber(sub(s, i, e - 1)), e
+  end
+end
+
+decode = function(s) return (value(s, 1)) end
+
+return {
+  ops = 20000,
+  run = function(n)
+    local t
+    for i = 1, n do
+      t = decode(doc)
+    end
+    assert(t.pos.z == 3.25 and t.tags[3] == "def")
+    return t
+  end
+}
@@ -0,0 +1,11 @@
+-- Tight loop over ROM module functions, like gpio.write/tmr.now in handlers
+return {
+  ops = 200000,
+  run = function(n)
+    local acc = 0
+    for i = 1, n do
+      acc = acc + math.floor(i / 3) + string.len("pin") + math.max(i % 5, 2)
+    end
+    return acc
+  end
+}
@@ -0,0 +1,16 @@
+-- CPU-bound numeric handler: complementary filter over synthetic IMU samples
+return {
+  ops = 200000,
+  run = function(n)
+    local angle, bias, dt, k = 0, 0, 0.01, 0.98
+    local ax, gy = 0, 0
+    for i = 1, n do
+      ax = (i % 50) * 0.02 - 0.5
+      gy = ((i * 7) % 33) * 0.1 - 1.6
+      local rate = gy - bias
+      angle = k * (angle + rate * dt) + (1 - k) * ax
+      if angle > 1 then bias = bias + 0.001 elseif angle < -1 then bias = bias - 0.001 end
+    end
+    return angle
+  end
+}
@@ -0,0 +1,14 @@
+-- Building reply strings piecewise, as HTTP/MQTT handlers do
+return {
+  ops = 50000,
+  run = function(n)
+    local s
+    for i = 1, n do
+      s = "GET /api/" .. i .. " HTTP/1.1\r\nHost: node-" .. (i % 97) .. "\r\n"
+      local parts = {}
+      for j = 1, 4 do parts[j] = s:sub(j, j + 8) end
+      s = table.concat(parts, ",")
+    end
+    return s
+  end
+}
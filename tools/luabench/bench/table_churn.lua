@@ -0,0 +1,13 @@
+-- Short-lived record and array tables, as created by sensor/config code
+return {
+  ops = 200000,
+  run = function(n)
+    local keep = {}
+    for i = 1, n do
+      local rec = { id = i, name = "sensor", value = i * 0.5, flags = {} }
+      rec.flags[1] = i % 2 == 0
+      keep[i % 64 + 1] = rec
+    end
+    return #keep
+  end
+}
@@ -0,0 +1,270 @@
+/*
+** luabench - host benchmark harness for the NodeMCU Lua VM
+**
+** Builds the firmware's own app/lua core (same lvm.c, ltable.c, lgc.c,
+** lstring.c, ... with LTR enabled) for the development host and runs a
+** set of Lua workloads against it, reporting throughput, peak heap and
+** GC activity as one JSON object per line so that results can be diffed
+** or collected by CI.
+**
+** See Copyright Notice in lua.h
+*/
+
+#define LUAC_CROSS_FILE
+
+#include "luac_cross.h"
+#include C_HEADER_STDIO
+#include C_HEADER_STDLIB
+#include C_HEADER_STRING
+#include <time.h>
+#include <getopt.h>
+
+#define LUA_CORE
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+#include "lrotable.h"
+#include "lstate.h"
+
+#define PROGNAME "luabench"
+
+/*
+** The firmware collects its library tables through linker sections (see
+** module.h); on the host we list the builtin libraries explicitly.
+*/
+extern const luaR_entry strlib[];
+extern const luaR_entry tab_funcs[];
+extern const luaR_entry math_map[];
+extern const luaR_entry co_funcs[];
+
+const luaL_Reg lua_libs[] = {
+  {"", luaopen_base},
+  {LUA_LOADLIBNAME, luaopen_package},
+  {LUA_STRLIBNAME, luaopen_string},
+  {LUA_TABLIBNAME, luaopen_table},
+  {NULL, NULL}
+};
+
+const luaR_table lua_rotable[] = {
+  {LUA_STRLIBNAME, strlib},
+  {LUA_TABLIBNAME, tab_funcs},
+  {LUA_MATHLIBNAME, math_map},
+  {LUA_COLIBNAME, co_funcs},
+  {NULL, NULL}
+};
+
+void luaL_openlibs (lua_State *L) {
+  const luaL_Reg *lib = lua_libs;
+  for (; lib->name; lib++) {
+    lua_pushcfunction(L, lib->func);
+    lua_pushstring(L, lib->name);
+    lua_call(L, 1, 0);
+  }
+}
+
+/* Allocation accounting, chained in front of the standard l_alloc */
+typedef struct {
+  lua_Alloc frealloc;
+  void *ud;
+  size_t current;
+  size_t peak;
+  unsigned long allocs;
+} bench_heap;
+
+static bench_heap heap;
+static unsigned long gc_cycles;
+static const char *progname = PROGNAME;
+
+static void *bench_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  bench_heap *h = (bench_heap *)ud;
+  void *nptr = h->frealloc(h->ud, ptr, osize, nsize);
+  if (nptr != NULL || nsize == 0) {
+    h->current += nsize - osize;
+    if (h->current > h->peak)
+      h->peak = h->current;
+    if (nsize > osize)
+      h->allocs++;
+  }
+  return nptr;
+}
+
+/*
+** GC cycle counter: a userdata whose finaliser bumps the count and plants
+** a fresh sentinel, so exactly one is collected per completed cycle.
+*/
+static int sentinel_gc (lua_State *L);
+
+static void new_sentinel (lua_State *L) {
+  lua_newuserdata(L, 1);
+  lua_pushlightuserdata(L, (void *)&gc_cycles);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+  lua_pop(L, 1);
+}
+
+static int sentinel_gc (lua_State *L) {
+  gc_cycles++;
+  new_sentinel(L);
+  return 0;
+}
+
+static void init_sentinel (lua_State *L) {
+  lua_pushlightuserdata(L, (void *)&gc_cycles);
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, sentinel_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+  new_sentinel(L);
+}
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage (void) {
+  fprintf(stderr,
+  "usage: %s [options] workload.lua ...\n"
+  "Available options are:\n"
+  "  -n scale   multiply each workload's default op count by scale\n"
+  "  -r runs    repeat each workload and report the fastest run (default 3)\n"
+  "  -l label   tag every result line with label\n"
+  "  -b us      limit incremental GC steps to us microseconds\n"
+  "  -o name    append results to file " LUA_QL("name") " instead of stdout\n",
+  progname);
+  exit(EXIT_FAILURE);
+}
+
+static const char *basename_of (const char *path) {
+  const char *p = strrchr(path, '/');
+  return p ? p + 1 : path;
+}
+
+/*
+** A workload file returns a table { ops = n, run = function(n) ... end }.
+** run(n) must perform n operations; ops is the default count.
+*/
+static int run_workload (FILE *out, const char *file, double scale,
+                         int runs, const char *label, lu_int32 budget) {
+  lua_State *L = lua_open();
+  double best = 0;
+  long ops;
+  int i;
+  size_t base_heap;
+  unsigned long base_cycles, base_allocs;
+  lu_int32 base_freed;
+  char name[64];
+
+  if (L == NULL) {
+    fprintf(stderr, "%s: not enough memory for state\n", progname);
+    return 1;
+  }
+  heap.frealloc = lua_getallocf(L, &heap.ud);
+  heap.current = G(L)->totalbytes;
+  lua_setallocf(L, bench_alloc, &heap);
+  G(L)->gcbudget = budget;
+  luaL_openlibs(L);
+
+  strncpy(name, basename_of(file), sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+  if (strrchr(name, '.'))
+    *strrchr(name, '.') = '\0';
+
+  if (luaL_loadfile(L, file) != 0 || lua_pcall(L, 0, 1, 0) != 0) {
+    fprintf(stderr, "%s: %s\n", progname, lua_tostring(L, -1));
+    lua_close(L);
+    return 1;
+  }
+  if (!lua_istable(L, -1)) {
+    fprintf(stderr, "%s: %s: workload must return a table\n", progname, file);
+    lua_close(L);
+    return 1;
+  }
+  lua_getfield(L, -1, "ops");
+  ops = (long)(lua_tonumber(L, -1) * scale);
+  lua_pop(L, 1);
+  if (ops < 1) ops = 1;
+
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  init_sentinel(L);
+  base_heap = heap.current;
+  heap.peak = heap.current;
+  base_allocs = heap.allocs;
+  base_cycles = gc_cycles;
+  G(L)->gcpausemax = G(L)->gcpausetotal = G(L)->gcpausecount = 0;
+  base_freed = G(L)->gcfreed;
+
+  for (i = 0; i < runs; i++) {
+    double t;
+    lua_getfield(L, -1, "run");
+    lua_pushnumber(L, (lua_Number)ops);
+    t = now();
+    if (lua_pcall(L, 1, 0, 0) != 0) {
+      fprintf(stderr, "%s: %s: %s\n", progname, name, lua_tostring(L, -1));
+      lua_close(L);
+      return 1;
+    }
+    t = now() - t;
+    if (i == 0 || t < best)
+      best = t;
+  }
+
+  fprintf(out, "{\"bench\":\"%s\"", name);
+  if (label)
+    fprintf(out, ",\"label\":\"%s\"", label);
+  fprintf(out, ",\"ops\":%ld,\"runs\":%d,\"seconds\":%.6f,\"ops_per_sec\":%.1f"
+               ",\"base_heap\":%lu,\"peak_heap\":%lu,\"allocs\":%lu"
+               ",\"gc_cycles\":%lu,\"gc_pause_max_us\":%lu"
+               ",\"gc_pause_avg_us\":%.1f,\"gc_last_cycle_us\":%lu"
+               ",\"gc_freed\":%lu}\n",
+          ops, runs, best, best > 0 ? ops / best : 0.0,
+          (unsigned long)base_heap, (unsigned long)heap.peak,
+          (heap.allocs - base_allocs) / runs,
+          (gc_cycles - base_cycles) / runs,
+          (unsigned long)G(L)->gcpausemax,
+          G(L)->gcpausecount ?
+            (double)G(L)->gcpausetotal / G(L)->gcpausecount : 0.0,
+          (unsigned long)G(L)->gclastcycle,
+          (unsigned long)(G(L)->gcfreed - base_freed) / runs);
+  fflush(out);
+  lua_close(L);
+  return 0;
+}
+
+int main (int argc, char *argv[]) {
+  double scale = 1;
+  int runs = 3;
+  const char *label = NULL;
+  lu_int32 budget = 0;
+  FILE *out = stdout;
+  int opt, i, status = 0;
+
+  if (argv[0] != NULL && *argv[0] != 0) progname = argv[0];
+  while ((opt = getopt(argc, argv, "n:r:l:b:o:")) != -1) {
+    switch (opt) {
+      case 'n': scale = atof(optarg); break;
+      case 'r': runs = atoi(optarg); break;
+      case 'l': label = optarg; break;
+      case 'b': budget = (lu_int32)atol(optarg); break;
+      case 'o':
+        out = fopen(optarg, "a");
+        if (out == NULL) {
+          perror(optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default: usage();
+    }
+  }
+  if (optind >= argc || runs < 1 || scale <= 0)
+    usage();
+
+  for (i = optind; i < argc; i++)
+    status |= run_workload(out, argv[i], scale, runs, label, budget);
+
+  if (out != stdout)
+    fclose(out);
+  return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,489 @@
+/*
+ * spiffsbench - offline SPIFFS throughput and garbage collection benchmark
+ *
+ * Runs the firmware's own app/spiffs code against a simulated SPI flash
+ * that charges realistic read, program and erase times to a virtual
+ * clock, replays file system workloads on it and reports throughput,
+ * write amplification, GC pause distribution and cache hit rate as one
+ * JSON object per line, in the same style as tools/luabench.
+ *
+ * GC pauses are timed by wrapping spiffs_gc_check() at link time (see
+ * the Makefile), so that the figures cover exactly the collections that
+ * stall foreground writes. With -g, SPIFFS_gc_idle() gets one call after
+ * each operation, as the firmware's background task would between Lua
+ * callbacks; that time is reported separately as idle_gc_ms.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <errno.h>
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+
+#define LOG_PAGE_SIZE       256
+#define ERASE_BLOCK_SIZE    0x1000
+#define MAX_OPEN_FILES      4
+#define SMALL_FILESYSTEM    (128 * 1024)
+
+/* Flash timing model, in microseconds; typical figures for the 25Q
+ * series parts on ESP8266 modules */
+static double t_erase = 45000;      /* per 4KB sector erase */
+static double t_program = 700;      /* per 256 byte page program */
+static double t_read = 0.1;         /* per byte read */
+static double t_access = 10;        /* per read or write call */
+
+static uint8_t *flash;
+static u32_t flash_size = 512 * 1024;
+static double clock_us;             /* virtual time spent in flash */
+static unsigned long long flash_written, flash_read_bytes;
+static unsigned long erases, flash_reads;
+
+static spiffs fs;
+static u8_t spiffs_work_buf[LOG_PAGE_SIZE*2];
+static u8_t spiffs_fds[sizeof(spiffs_fd) * MAX_OPEN_FILES];
+static u8_t bench_cache[sizeof(spiffs_cache) +
+                        (sizeof(spiffs_cache_page)+LOG_PAGE_SIZE)*SPIFFS_CACHE_PAGES];
+static int read_ahead = -1;         /* -r, or -1 for SPIFFS_CACHE_READ_AHEAD */
+
+static const char *progname = "spiffsbench";
+
+/* Durations of GC runs and of whole open-write-close sequences */
+typedef struct {
+  double *v;
+  size_t n, size;
+  double total;
+} samples;
+
+static samples gc_pauses, write_times;
+
+static void add_sample (samples *s, double us)
+{
+  if (s->n == s->size) {
+    s->size = s->size ? s->size * 2 : 256;
+    s->v = realloc (s->v, s->size * sizeof (double));
+    if (!s->v) {
+      fprintf (stderr, "%s: out of memory\n", progname);
+      exit (1);
+    }
+  }
+  s->v[s->n++] = us;
+  s->total += us;
+}
+
+static int cmp_double (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static double percentile (samples *s, int pct)
+{
+  if (!s->n)
+    return 0;
+  qsort (s->v, s->n, sizeof (double), cmp_double);
+  return s->v[(s->n - 1) * pct / 100];
+}
+
+
+static s32_t flash_read (u32_t addr, u32_t size, u8_t *dst) {
+  memcpy (dst, flash + addr, size);
+  clock_us += t_access + size * t_read;
+  flash_read_bytes += size;
+  flash_reads++;
+  return SPIFFS_OK;
+}
+
+/* NOR flash: programming can only clear bits */
+static s32_t flash_write (u32_t addr, u32_t size, u8_t *src) {
+  u32_t i;
+  for (i = 0; i < size; i++)
+    flash[addr + i] &= src[i];
+  clock_us += t_access + t_program * (size + LOG_PAGE_SIZE - 1) / LOG_PAGE_SIZE;
+  flash_written += size;
+  return SPIFFS_OK;
+}
+
+static s32_t flash_erase (u32_t addr, u32_t size) {
+  memset (flash + addr, 0xff, size);
+  clock_us += t_erase * (size / ERASE_BLOCK_SIZE);
+  erases += size / ERASE_BLOCK_SIZE;
+  return SPIFFS_OK;
+}
+
+
+/* Time every collection that a write has to wait for */
+s32_t __real_spiffs_gc_check (spiffs *fs, u32_t len);
+
+s32_t __wrap_spiffs_gc_check (spiffs *fs, u32_t len)
+{
+  u32_t runs = fs->stats_gc_runs;
+  double start = clock_us;
+  s32_t res = __real_spiffs_gc_check (fs, len);
+  if (fs->stats_gc_runs != runs)
+    add_sample (&gc_pauses, clock_us - start);
+  return res;
+}
+
+
+static void mount (void)
+{
+  spiffs_config cfg;
+  memset (flash, 0xff, flash_size);
+  cfg.phys_size = flash_size;
+  cfg.phys_addr = 0;
+  cfg.phys_erase_block = ERASE_BLOCK_SIZE;
+  cfg.log_block_size = ERASE_BLOCK_SIZE * (flash_size > SMALL_FILESYSTEM ? 2 : 1);
+  cfg.log_page_size = LOG_PAGE_SIZE;
+  cfg.hal_read_f = flash_read;
+  cfg.hal_write_f = flash_write;
+  cfg.hal_erase_f = flash_erase;
+  SPIFFS_mount (&fs, &cfg, spiffs_work_buf, spiffs_fds, sizeof (spiffs_fds),
+                bench_cache, sizeof (bench_cache), 0);
+  SPIFFS_unmount (&fs);
+  if (SPIFFS_format (&fs) != 0 ||
+      SPIFFS_mount (&fs, &cfg, spiffs_work_buf, spiffs_fds, sizeof (spiffs_fds),
+                    bench_cache, sizeof (bench_cache), 0) != 0) {
+    fprintf (stderr, "%s: cannot format the simulated flash\n", progname);
+    exit (1);
+  }
+#if SPIFFS_CACHE_READ_AHEAD
+  if (read_ahead >= 0)
+    spiffs_get_cache (&fs)->ra_max =
+      MIN (read_ahead, spiffs_get_cache (&fs)->cpage_count - 1);
+#endif
+}
+
+
+/* Workload operations; each returns false if the file system is full */
+static unsigned long ops, full;
+static unsigned long long user_bytes;
+static char data[16384];
+static u32_t idle_blocks;           /* blocks kept free by idle GC, or 0 */
+static double idle_us;
+
+static void idle (void)
+{
+  double start = clock_us;
+  if (idle_blocks) {
+    SPIFFS_gc_idle (&fs, idle_blocks);
+    idle_us += clock_us - start;
+  }
+}
+
+static bool put (const char *name, u32_t len, spiffs_flags how)
+{
+  double start = clock_us;
+  spiffs_file fh = SPIFFS_open (&fs, name, how | SPIFFS_CREAT | SPIFFS_WRONLY, 0);
+  bool ok = fh >= 0;
+  ops++;
+  while (ok && len > 0) {
+    u32_t n = len < sizeof (data) ? len : sizeof (data);
+    ok = SPIFFS_write (&fs, fh, data, n) == (s32_t)n;
+    if (ok)
+      user_bytes += n;
+    len -= n;
+  }
+  if (fh >= 0 && SPIFFS_close (&fs, fh) < 0)
+    ok = false;
+  add_sample (&write_times, clock_us - start);
+  if (!ok)
+    full++;
+  idle ();
+  return ok;
+}
+
+static void get (const char *name, u32_t chunk)
+{
+  spiffs_file fh = SPIFFS_open (&fs, name, SPIFFS_RDONLY, 0);
+  ops++;
+  if (fh < 0)
+    return;
+  while (SPIFFS_read (&fs, fh, data, chunk) > 0)
+    ;
+  SPIFFS_close (&fs, fh);
+}
+
+static void rm (const char *name)
+{
+  ops++;
+  SPIFFS_remove (&fs, name);
+  idle ();
+}
+
+
+/* Fill the file system to pct percent with files that never change */
+static void prefill (int pct)
+{
+  u32_t total, used;
+  int i;
+  char name[32];
+  SPIFFS_info (&fs, &total, &used);
+  for (i = 0; used < total / 100 * pct; i++) {
+    sprintf (name, "static%d", i);
+    if (!put (name, 4096, SPIFFS_TRUNC))
+      break;
+    SPIFFS_info (&fs, &total, &used);
+  }
+}
+
+
+/* Append 64 byte records to a log, rotating it at 16KB */
+static void wl_log (int n)
+{
+  spiffs_stat st;
+  int i;
+  for (i = 0; i < n; i++) {
+    put ("log.txt", 64, SPIFFS_APPEND);
+    if (SPIFFS_stat (&fs, "log.txt", &st) == 0 && st.size >= 16384) {
+      rm ("log.old");
+      SPIFFS_rename (&fs, "log.txt", "log.old");
+    }
+  }
+}
+
+/* Rewrite a handful of small configuration files */
+static void wl_config (int n)
+{
+  int i;
+  char name[32];
+  for (i = 0; i < n; i++) {
+    sprintf (name, "config%d.json", rand () % 8);
+    put (name, 200 + rand () % 800, SPIFFS_TRUNC);
+  }
+}
+
+/* Create and delete files of random sizes */
+static void wl_churn (int n)
+{
+  int i;
+  char name[32];
+  for (i = 0; i < n; i++) {
+    sprintf (name, "file%d", rand () % 16);
+    if (rand () % 3 == 0)
+      rm (name);
+    else if (!put (name, 1024 + rand () % 7168, SPIFFS_TRUNC))
+      rm (name);
+    if (rand () % 4 == 0) {
+      sprintf (name, "file%d", rand () % 16);
+      get (name, sizeof (data));
+    }
+  }
+}
+
+/* Serve a 96KB asset in 1KB reads, as file.read() does */
+static void wl_stream (int n)
+{
+  int i;
+  put ("index.html", 96 * 1024, SPIFFS_TRUNC);
+  for (i = 0; i < n; i++)
+    get ("index.html", 1024);
+}
+
+/*
+ * A script replays one operation per line:
+ *   write <name> <bytes>     create or truncate, then write
+ *   append <name> <bytes>
+ *   read <name>
+ *   rm <name>
+ *   mv <old> <new>
+ * Empty lines and lines starting with # are ignored.
+ */
+static bool wl_script (const char *script)
+{
+  FILE *in = fopen (script, "r");
+  char line[256], a[128], b[128];
+  unsigned len;
+  int lineno = 0;
+  if (!in) {
+    perror (script);
+    return false;
+  }
+  while (fgets (line, sizeof (line), in)) {
+    char *p = line;
+    lineno++;
+    while (isspace ((unsigned char)*p))
+      p++;
+    if (!*p || *p == '#')
+      continue;
+    if (sscanf (p, "write %127s %u", a, &len) == 2)
+      put (a, len, SPIFFS_TRUNC);
+    else if (sscanf (p, "append %127s %u", a, &len) == 2)
+      put (a, len, SPIFFS_APPEND);
+    else if (sscanf (p, "read %127s", a) == 1)
+      get (a, sizeof (data));
+    else if (sscanf (p, "rm %127s", a) == 1)
+      rm (a);
+    else if (sscanf (p, "mv %127s %127s", a, b) == 2) {
+      ops++;
+      SPIFFS_rename (&fs, a, b);
+    }
+    else {
+      fprintf (stderr, "%s: %s:%d: syntax error\n", progname, script, lineno);
+      fclose (in);
+      return false;
+    }
+  }
+  fclose (in);
+  return true;
+}
+
+
+static const struct {
+  const char *name;
+  void (*run) (int n);
+  int ops;
+} workloads[] = {
+  { "log",    wl_log,    20000 },
+  { "config", wl_config, 5000 },
+  { "churn",  wl_churn,  2000 },
+  { "stream", wl_stream, 50 },
+  { NULL, NULL, 0 }
+};
+
+
+static int run_workload (FILE *out, const char *name, double scale,
+                         int pct, const char *label)
+{
+  int i;
+  double start;
+  unsigned long long base_written;
+  unsigned long base_erases, base_ops, base_reads;
+
+  srand (1);
+  mount ();
+  prefill (pct);
+  start = clock_us;
+  base_written = flash_written;
+  base_erases = erases;
+  base_reads = flash_reads;
+  base_ops = ops;
+  user_bytes = 0;
+  full = 0;
+  gc_pauses.n = 0;
+  gc_pauses.total = 0;
+  write_times.n = 0;
+  write_times.total = 0;
+  idle_us = 0;
+  fs.stats_gc_runs = 0;
+  fs.cache_hits = fs.cache_misses = 0;
+
+  for (i = 0; workloads[i].name; i++)
+    if (strcmp (workloads[i].name, name) == 0)
+      break;
+  if (workloads[i].name) {
+    int n = workloads[i].ops * scale;
+    workloads[i].run (n > 0 ? n : 1);
+  }
+  else if (!wl_script (name)) {
+    SPIFFS_unmount (&fs);
+    return 1;
+  }
+
+  double secs = (clock_us - start - idle_us) / 1e6;
+  const char *base = strrchr (name, '/') ? strrchr (name, '/') + 1 : name;
+  fprintf (out, "{\"bench\":\"%s\"", base);
+  if (label)
+    fprintf (out, ",\"label\":\"%s\"", label);
+  fprintf (out, ",\"ops\":%lu,\"bytes\":%llu,\"flash_seconds\":%.3f"
+                ",\"kbytes_per_sec\":%.1f,\"write_amp\":%.2f,\"erases\":%lu"
+                ",\"flash_reads\":%lu"
+                ",\"full\":%lu,\"gc_runs\":%u,\"gc_pause_total_ms\":%.1f"
+                ",\"gc_pause_p50_ms\":%.1f,\"gc_pause_p99_ms\":%.1f"
+                ",\"gc_pause_max_ms\":%.1f,\"write_p99_ms\":%.1f"
+                ",\"write_max_ms\":%.1f,\"idle_gc_ms\":%.1f"
+                ",\"cache_hit_rate\":%.3f}\n",
+          ops - base_ops, user_bytes, secs,
+          secs > 0 ? user_bytes / 1024.0 / secs : 0.0,
+          user_bytes ? (double)(flash_written - base_written) / user_bytes : 0.0,
+          erases - base_erases, flash_reads - base_reads, full, fs.stats_gc_runs,
+          gc_pauses.total / 1000,
+          percentile (&gc_pauses, 50) / 1000, percentile (&gc_pauses, 99) / 1000,
+          percentile (&gc_pauses, 100) / 1000,
+          percentile (&write_times, 99) / 1000,
+          percentile (&write_times, 100) / 1000,
+          idle_us / 1000,
+          fs.cache_hits + fs.cache_misses ?
+            (double)fs.cache_hits / (fs.cache_hits + fs.cache_misses) : 0.0);
+  fflush (out);
+  SPIFFS_unmount (&fs);
+  return 0;
+}
+
+
+static void usage (void)
+{
+  int i;
+  fprintf (stderr,
+    "usage: %s [options] workload ...\n"
+    "A workload is a script file or one of:", progname);
+  for (i = 0; workloads[i].name; i++)
+    fprintf (stderr, " %s", workloads[i].name);
+  fprintf (stderr, "\n"
+    "Available options are:\n"
+    "  -s size    file system size in bytes (default 512k)\n"
+    "  -p pct     fill the file system to pct%% with static files first (default 50)\n"
+    "  -n scale   multiply each built-in workload's op count by scale\n"
+    "  -e us      sector erase time (default %.0f)\n"
+    "  -w us      page program time (default %.0f)\n"
+    "  -g blocks  collect garbage between operations to keep blocks free\n"
+    "  -r pages   read ahead at most pages (default SPIFFS_CACHE_READ_AHEAD)\n"
+    "  -l label   tag every result line with label\n"
+    "  -o name    append results to file name instead of stdout\n",
+    t_erase, t_program);
+  exit (1);
+}
+
+int main (int argc, char *argv[])
+{
+  double scale = 1;
+  int pct = 50;
+  const char *label = NULL;
+  FILE *out = stdout;
+  int opt, i, status = 0;
+
+  if (argv[0] != NULL && *argv[0] != 0) progname = argv[0];
+  while ((opt = getopt (argc, argv, "s:p:n:e:w:g:r:l:o:")) != -1)
+  {
+    switch (opt)
+    {
+      case 's': flash_size = strtoul (optarg, 0, 0); break;
+      case 'p': pct = atoi (optarg); break;
+      case 'n': scale = atof (optarg); break;
+      case 'e': t_erase = atof (optarg); break;
+      case 'w': t_program = atof (optarg); break;
+      case 'g': idle_blocks = strtoul (optarg, 0, 0); break;
+      case 'r': read_ahead = atoi (optarg); break;
+      case 'l': label = optarg; break;
+      case 'o':
+        out = fopen (optarg, "a");
+        if (!out) {
+          perror (optarg);
+          return 1;
+        }
+        break;
+      default: usage ();
+    }
+  }
+  flash_size &= ~(ERASE_BLOCK_SIZE * 2 - 1);
+  if (optind >= argc || scale <= 0 || pct < 0 || pct > 95 ||
+      flash_size < 4 * 2 * ERASE_BLOCK_SIZE)
+    usage ();
+
+  flash = malloc (flash_size);
+  if (!flash) {
+    fprintf (stderr, "%s: out of memory\n", progname);
+    return 1;
+  }
+  memset (data, 'x', sizeof (data));
+  for (i = optind; i < argc; i++)
+    status |= run_workload (out, argv[i], scale, pct, label);
+
+  if (out != stdout)
+    fclose (out);
+  free (flash);
+  return status;
+}